@@ -0,0 +1,53 @@
+// affine.h
+
+#pragma once
+
+#include <cmath>
+
+// 2D affine map in document units:
+//   x' = a * x + b * y + tx
+//   y' = c * x + d * y + ty
+struct Affine2D {
+    float a = 1.0f, b = 0.0f, c = 0.0f, d = 1.0f;
+    float tx = 0.0f, ty = 0.0f;
+
+    static Affine2D Translation(float dx, float dy) { return { 1.0f, 0.0f, 0.0f, 1.0f, dx, dy }; }
+
+    // Counter-clockwise by `degrees` about (px, py). Quarter turns are exact.
+    static Affine2D Rotation(float degrees, float px, float py) {
+        float s, co;
+        float turns = degrees / 90.0f;
+        if (turns == std::floor(turns)) {
+            int q = ((int)turns % 4 + 4) % 4;
+            static const float sines[4] = { 0.0f, 1.0f, 0.0f, -1.0f };
+            s = sines[q];
+            co = sines[(q + 1) % 4];
+        } else {
+            float rad = degrees * 3.14159265358979f / 180.0f;
+            s = std::sin(rad);
+            co = std::cos(rad);
+        }
+        return about({ co, -s, s, co, 0.0f, 0.0f }, px, py);
+    }
+
+    // Flip left-right (horizontal) or top-bottom about (px, py)
+    static Affine2D Mirror(bool horizontal, float px, float py) {
+        return horizontal ? about({ -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f }, px, py)
+                          : about({ 1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f }, px, py);
+    }
+
+    static Affine2D Scale(float factor, float px, float py) {
+        return about({ factor, 0.0f, 0.0f, factor, 0.0f, 0.0f }, px, py);
+    }
+
+    // How lengths scale; exact for rotations, mirrors and uniform scales,
+    // which are the only maps that keep circles circular
+    float LengthScale() const { return std::sqrt(std::fabs(a * d - b * c)); }
+
+private:
+    static Affine2D about(Affine2D m, float px, float py) {
+        m.tx = px - (m.a * px + m.b * py);
+        m.ty = py - (m.c * px + m.d * py);
+        return m;
+    }
+};
@@ -0,0 +1,8 @@
+// bounds.h
+
+#pragma once
+
+// Axis-aligned bounding box in document units
+struct Bounds {
+    float minX, minY, maxX, maxY;
+};
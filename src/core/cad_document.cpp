@@ -3,19 +3,921 @@
 #include "cad_document.h"
 #include "entity/line_entity.h"
 #include "entity/circle_entity.h"
+#include "entity/track_entity.h"
 #include <memory>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <tuple>
 
 
+void LineArrays::Reserve(size_t count) {
+    x1.reserve(count);
+    y1.reserve(count);
+    x2.reserve(count);
+    y2.reserve(count);
+}
+
+void LineArrays::Add(float ax, float ay, float bx, float by) {
+    x1.push_back(ax);
+    y1.push_back(ay);
+    x2.push_back(bx);
+    y2.push_back(by);
+}
+
+void LineArrays::Clear() {
+    x1.clear();
+    y1.clear();
+    x2.clear();
+    y2.clear();
+}
+
+void CircleArrays::Reserve(size_t count) {
+    cx.reserve(count);
+    cy.reserve(count);
+    r.reserve(count);
+}
+
+void CircleArrays::Add(float x, float y, float radius) {
+    cx.push_back(x);
+    cy.push_back(y);
+    r.push_back(radius);
+}
+
+void CircleArrays::Clear() {
+    cx.clear();
+    cy.clear();
+    r.clear();
+}
+
+void TrackArrays::Reserve(size_t count) {
+    x1.reserve(count);
+    y1.reserve(count);
+    x2.reserve(count);
+    y2.reserve(count);
+    width.reserve(count);
+}
+
+void TrackArrays::Add(float ax, float ay, float bx, float by, float w) {
+    x1.push_back(ax);
+    y1.push_back(ay);
+    x2.push_back(bx);
+    y2.push_back(by);
+    width.push_back(w);
+}
+
+void TrackArrays::Clear() {
+    x1.clear();
+    y1.clear();
+    x2.clear();
+    y2.clear();
+    width.clear();
+}
+
 CADDocument::CADDocument() {
     // Optionally create default layer
     AddLayer("Default");
 }
 
 void CADDocument::AddLayer(const std::string& name) {
-    layers.push_back(Layer{ name });
+    Layer layer;
+    layer.name = name;
+    layer.id = nextLayerId++;
+    layers.push_back(std::move(layer));
+    revision++;
+}
+
+void CADDocument::SetLayerVisible(size_t layerIndex, bool visible) {
+    if (layerIndex >= layers.size() || layers[layerIndex].visible == visible) return;
+    layers[layerIndex].visible = visible;
+    revision++;
+}
+
+void CADDocument::MoveLayer(size_t from, size_t to) {
+    if (from >= layers.size() || to >= layers.size() || from == to) return;
+    if (from < to)
+        std::rotate(layers.begin() + from, layers.begin() + from + 1, layers.begin() + to + 1);
+    else
+        std::rotate(layers.begin() + to, layers.begin() + from, layers.begin() + from + 1);
+    revision++;
+}
+
+size_t Layer::Size(EntityKind kind) const {
+    switch (kind) {
+    case EntityKind::Line: return lines.Size();
+    case EntityKind::Circle: return circles.Size();
+    case EntityKind::Track: return tracks.Size();
+    }
+    return 0;
+}
+
+// Both FieldArrays overloads; Vec carries the constness of L
+template <typename L, typename Vec>
+static size_t fieldArrays(L& layer, EntityKind kind, Vec** out) {
+    switch (kind) {
+    case EntityKind::Line:
+        out[0] = &layer.lines.x1; out[1] = &layer.lines.y1; out[2] = &layer.lines.x2; out[3] = &layer.lines.y2;
+        return 4;
+    case EntityKind::Circle:
+        out[0] = &layer.circles.cx; out[1] = &layer.circles.cy; out[2] = &layer.circles.r;
+        return 3;
+    case EntityKind::Track:
+        out[0] = &layer.tracks.x1; out[1] = &layer.tracks.y1; out[2] = &layer.tracks.x2; out[3] = &layer.tracks.y2;
+        out[4] = &layer.tracks.width;
+        return 5;
+    }
+    return 0;
+}
+
+size_t Layer::FieldArrays(EntityKind kind, std::vector<float>** out) {
+    return fieldArrays(*this, kind, out);
+}
+
+size_t Layer::FieldArrays(EntityKind kind, const std::vector<float>** out) const {
+    return fieldArrays(*this, kind, out);
+}
+
+Bounds Layer::EntityBounds(EntityKind kind, uint32_t i) const {
+    switch (kind) {
+    case EntityKind::Line:
+        return { std::min(lines.x1[i], lines.x2[i]), std::min(lines.y1[i], lines.y2[i]),
+                 std::max(lines.x1[i], lines.x2[i]), std::max(lines.y1[i], lines.y2[i]) };
+    case EntityKind::Circle:
+        return { circles.cx[i] - circles.r[i], circles.cy[i] - circles.r[i],
+                 circles.cx[i] + circles.r[i], circles.cy[i] + circles.r[i] };
+    case EntityKind::Track: {
+        float hw = 0.5f * tracks.width[i];
+        return { std::min(tracks.x1[i], tracks.x2[i]) - hw, std::min(tracks.y1[i], tracks.y2[i]) - hw,
+                 std::max(tracks.x1[i], tracks.x2[i]) + hw, std::max(tracks.y1[i], tracks.y2[i]) + hw };
+    }
+    }
+    return { 0.0f, 0.0f, 0.0f, 0.0f };
+}
+
+size_t Layer::SnapPointsOf(EntityKind kind, uint32_t i, SnapPoint* out) const {
+    const std::vector<float> *x1, *y1, *x2, *y2;
+    switch (kind) {
+    case EntityKind::Circle:
+        out[0] = { circles.cx[i], circles.cy[i], i, kind, SnapKind::Center };
+        return 1;
+    case EntityKind::Line:
+        x1 = &lines.x1; y1 = &lines.y1; x2 = &lines.x2; y2 = &lines.y2;
+        break;
+    case EntityKind::Track:
+        x1 = &tracks.x1; y1 = &tracks.y1; x2 = &tracks.x2; y2 = &tracks.y2;
+        break;
+    default:
+        return 0;
+    }
+    float ax = (*x1)[i], ay = (*y1)[i], bx = (*x2)[i], by = (*y2)[i];
+    out[0] = { ax, ay, i, kind, SnapKind::Endpoint };
+    out[1] = { bx, by, i, kind, SnapKind::Endpoint };
+    out[2] = { 0.5f * (ax + bx), 0.5f * (ay + by), i, kind, SnapKind::Midpoint };
+    return 3;
+}
+
+static float segmentDistance(float px, float py, float ax, float ay, float bx, float by) {
+    float dx = bx - ax, dy = by - ay;
+    float len2 = dx * dx + dy * dy;
+    float t = len2 > 0.0f ? std::clamp(((px - ax) * dx + (py - ay) * dy) / len2, 0.0f, 1.0f) : 0.0f;
+    float ex = px - (ax + t * dx), ey = py - (ay + t * dy);
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+float Layer::EntityDistance(EntityKind kind, uint32_t i, float x, float y) const {
+    switch (kind) {
+    case EntityKind::Line:
+        return segmentDistance(x, y, lines.x1[i], lines.y1[i], lines.x2[i], lines.y2[i]);
+    case EntityKind::Circle:
+        // Circles are drawn as outlines
+        return std::fabs(std::hypot(x - circles.cx[i], y - circles.cy[i]) - circles.r[i]);
+    case EntityKind::Track:
+        return std::max(0.0f, segmentDistance(x, y, tracks.x1[i], tracks.y1[i], tracks.x2[i], tracks.y2[i]) -
+                              0.5f * tracks.width[i]);
+    }
+    return FLT_MAX;
+}
+
+EntityId CADDocument::AddLine(size_t layerIndex, float x1, float y1, float x2, float y2) {
+    if (layerIndex >= layers.size()) return {};
+    Layer& layer = layers[layerIndex];
+    layer.lines.Add(x1, y1, x2, y2);
+    EntityId id = issueId(layer, EntityKind::Line);
+    indexEntity(layer, EntityKind::Line, (uint32_t)layer.lines.Size() - 1);
+    recordInsert(layer, EntityKind::Line, (uint32_t)layer.lines.Size() - 1);
+    layer.revision++;
+    revision++;
+    return id;
+}
+
+EntityId CADDocument::AddCircle(size_t layerIndex, float cx, float cy, float radius) {
+    if (layerIndex >= layers.size()) return {};
+    Layer& layer = layers[layerIndex];
+    layer.circles.Add(cx, cy, radius);
+    EntityId id = issueId(layer, EntityKind::Circle);
+    indexEntity(layer, EntityKind::Circle, (uint32_t)layer.circles.Size() - 1);
+    recordInsert(layer, EntityKind::Circle, (uint32_t)layer.circles.Size() - 1);
+    layer.revision++;
+    revision++;
+    return id;
+}
+
+EntityId CADDocument::AddTrack(size_t layerIndex, float x1, float y1, float x2, float y2, float width) {
+    if (layerIndex >= layers.size()) return {};
+    Layer& layer = layers[layerIndex];
+    layer.tracks.Add(x1, y1, x2, y2, width);
+    EntityId id = issueId(layer, EntityKind::Track);
+    indexEntity(layer, EntityKind::Track, (uint32_t)layer.tracks.Size() - 1);
+    recordInsert(layer, EntityKind::Track, (uint32_t)layer.tracks.Size() - 1);
+    layer.revision++;
+    revision++;
+    return id;
+}
+
+// Keeps the layer's spatial and snap indexes in step with a new entity;
+// during a bulk load both are built once at the end instead
+void CADDocument::indexEntity(Layer& layer, EntityKind kind, uint32_t i) {
+    layer.structureRevision = layer.revision + 1;   // Callers bump revision right after
+    layer.edits.clear();
+    if (bulkLoading) return;
+    layer.index.Insert(kind, i, layer.EntityBounds(kind, i));
+    SnapPoint points[Layer::MAX_SNAP_POINTS];
+    size_t n = layer.SnapPointsOf(kind, i, points);
+    for (size_t k = 0; k < n; k++) layer.snaps.Insert(points[k]);
+}
+
+void CADDocument::unindexEntity(Layer& layer, EntityKind kind, uint32_t i) {
+    if (bulkLoading) return;
+    layer.index.Remove(kind, i);
+    SnapPoint points[Layer::MAX_SNAP_POINTS];
+    size_t n = layer.SnapPointsOf(kind, i, points);
+    for (size_t k = 0; k < n; k++) layer.snaps.Remove(points[k]);
+}
+
+EntityId CADDocument::issueId(Layer& layer, EntityKind kind) {
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = (uint32_t)slots.size();
+        slots.emplace_back();
+    }
+    std::vector<uint32_t>& slotOf = layer.slots[(size_t)kind];
+    Slot& s = slots[slot];
+    s = { layer.id, (uint32_t)slotOf.size(), s.nextGeneration, s.nextGeneration + 1, kind, true };
+    slotOf.push_back(slot);
+    return { slot, s.generation };
+}
+
+// Undo and redo hand back the exact id an entity had, so the slot is taken
+// off the free list (last in, so normally at its end) with that generation
+void CADDocument::reviveId(EntityId id, Layer& layer, EntityKind kind, uint32_t index) {
+    auto it = std::find(freeSlots.rbegin(), freeSlots.rend(), id.slot);
+    if (it != freeSlots.rend()) freeSlots.erase(std::next(it).base());
+    Slot& s = slots[id.slot];
+    s = { layer.id, index, id.generation, std::max(s.nextGeneration, id.generation + 1), kind, true };
+    layer.slots[(size_t)kind][index] = id.slot;
+}
+
+void CADDocument::removeAt(Layer& layer, EntityKind kind, uint32_t index) {
+    std::vector<float>* fields[Layer::MAX_FIELDS];
+    size_t n = layer.FieldArrays(kind, fields);
+    std::vector<uint32_t>& slotOf = layer.slots[(size_t)kind];
+    uint32_t last = (uint32_t)slotOf.size() - 1;
+
+    unindexEntity(layer, kind, index);
+    slots[slotOf[index]].live = false;
+    freeSlots.push_back(slotOf[index]);
+    if (index != last) {
+        unindexEntity(layer, kind, last);
+        for (size_t f = 0; f < n; f++) (*fields[f])[index] = (*fields[f])[last];
+        slotOf[index] = slotOf[last];
+        slots[slotOf[index]].index = index;
+    }
+    for (size_t f = 0; f < n; f++) fields[f]->pop_back();
+    slotOf.pop_back();
+    if (index != last) indexEntity(layer, kind, index);
+    layer.structureRevision = layer.revision + 1;
+    layer.edits.clear();
+}
+
+void CADDocument::insertAt(Layer& layer, EntityKind kind, uint32_t index, EntityId id, const float* values, size_t stride) {
+    std::vector<float>* fields[Layer::MAX_FIELDS];
+    size_t n = layer.FieldArrays(kind, fields);
+    std::vector<uint32_t>& slotOf = layer.slots[(size_t)kind];
+    uint32_t end = (uint32_t)slotOf.size();
+
+    // The entity in the way goes back to the end, where it came from
+    if (index < end) {
+        unindexEntity(layer, kind, index);
+        for (size_t f = 0; f < n; f++) {
+            float v = (*fields[f])[index];
+            fields[f]->push_back(v);
+        }
+        uint32_t moved = slotOf[index];
+        slotOf.push_back(moved);
+        slots[moved].index = end;
+        indexEntity(layer, kind, end);
+    } else {
+        for (size_t f = 0; f < n; f++) fields[f]->push_back(0.0f);
+        slotOf.push_back(0);
+    }
+    for (size_t f = 0; f < n; f++) (*fields[f])[index] = values[f * stride];
+    reviveId(id, layer, kind, index);
+    indexEntity(layer, kind, index);
+}
+
+EntityId CADDocument::IdOf(const EntityRef& ref) const {
+    const Layer* layer = FindLayer(ref.layerId);
+    if (!layer || ref.index >= layer->Size(ref.kind)) return {};
+    uint32_t slot = layer->slots[(size_t)ref.kind][ref.index];
+    return { slot, slots[slot].generation };
+}
+
+bool CADDocument::Resolve(EntityId id, EntityRef& out) const {
+    if (id.slot >= slots.size()) return false;
+    const Slot& s = slots[id.slot];
+    if (!s.live || s.generation != id.generation) return false;
+    out = { s.layerId, s.kind, s.index };
+    return true;
+}
+
+void CADDocument::DeleteEntities(const std::vector<EntityId>& ids) {
+    std::vector<EntityRef> refs;
+    for (EntityId id : ids) {
+        EntityRef ref;
+        if (Resolve(id, ref)) refs.push_back(ref);
+    }
+    if (refs.empty()) return;
+
+    // Highest index first: the entity moved into each freed place comes from
+    // past every index still to delete, so none of those move
+    std::sort(refs.begin(), refs.end(), [](const EntityRef& a, const EntityRef& b) {
+        return std::tie(a.layerId, a.kind, b.index) < std::tie(b.layerId, b.kind, a.index);
+    });
+    refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+
+    if (!bulkLoading) journal.BeginStep();
+    for (size_t group = 0; group < refs.size();) {
+        size_t end = group;
+        while (end < refs.size() && refs[end].layerId == refs[group].layerId && refs[end].kind == refs[group].kind)
+            end++;
+        Layer& layer = *findLayer(refs[group].layerId);
+        EntityKind kind = refs[group].kind;
+        size_t count = end - group;
+
+        // Index, slot and generation of each entity, then its values
+        std::vector<float>* fields[Layer::MAX_FIELDS];
+        size_t n = layer.FieldArrays(kind, fields);
+        EditJournal::Record* record = bulkLoading ? nullptr :
+            journal.AddRecord(EditJournal::Op::Remove, kind, layer.id, 0, (uint32_t)count, 3, (uint8_t)n);
+        for (size_t k = 0; k < count; k++) {
+            uint32_t i = refs[group + k].index;
+            if (record) {
+                uint32_t slot = layer.slots[(size_t)kind][i];
+                record->Column(0)[k] = i;
+                record->Column(1)[k] = slot;
+                record->Column(2)[k] = slots[slot].generation;
+                for (size_t f = 0; f < n; f++) record->Values()[f * count + k] = (*fields[f])[i];
+            }
+            removeAt(layer, kind, i);
+        }
+        layer.revision++;
+        group = end;
+    }
+    if (!bulkLoading) journal.EndStep();
+
+    dropStaleViewIds();
+    revision++;
+}
+
+void CADDocument::dropStaleViewIds() {
+    size_t before = selection.size();
+    selection.erase(std::remove_if(selection.begin(), selection.end(), [&](EntityId id) { return !Contains(id); }),
+                    selection.end());
+    bool changed = selection.size() != before;
+    if (!hover.IsNull() && !Contains(hover)) {
+        hover = EntityId{};
+        changed = true;
+    }
+    if (changed) selectionChanged();
+}
+
+// Values, slots and generations are filled in when the step is undone
+void CADDocument::recordInsert(Layer& layer, EntityKind kind, uint32_t index) {
+    if (bulkLoading) return;
+    std::vector<float>* fields[Layer::MAX_FIELDS];
+    size_t n = layer.FieldArrays(kind, fields);
+    journal.BeginStep();
+    journal.AddRecord(EditJournal::Op::Insert, kind, layer.id, index, 1, 2, (uint8_t)n);
+    journal.EndStep();
+}
+
+// Undo steps recorded before the load would not know about what it adds
+void CADDocument::BeginBulkLoad() {
+    bulkLoading = true;
+    journal.Clear();
+}
+
+void CADDocument::EndBulkLoad() {
+    if (!bulkLoading) return;
+    bulkLoading = false;
+
+    std::vector<SpatialIndex::Entry> entries;
+    std::vector<SnapPoint> points;
+    for (Layer& layer : layers) {
+        entries.clear();
+        entries.reserve(layer.lines.Size() + layer.circles.Size() + layer.tracks.Size());
+        for (uint32_t i = 0; i < layer.lines.Size(); ++i)
+            entries.push_back({ EntityKind::Line, i, layer.EntityBounds(EntityKind::Line, i) });
+        for (uint32_t i = 0; i < layer.circles.Size(); ++i)
+            entries.push_back({ EntityKind::Circle, i, layer.EntityBounds(EntityKind::Circle, i) });
+        for (uint32_t i = 0; i < layer.tracks.Size(); ++i)
+            entries.push_back({ EntityKind::Track, i, layer.EntityBounds(EntityKind::Track, i) });
+        layer.index.BulkLoad(entries);
+
+        points.clear();
+        points.reserve(3 * (layer.lines.Size() + layer.tracks.Size()) + layer.circles.Size());
+        for (const SpatialIndex::Entry& e : entries) {
+            SnapPoint entity[Layer::MAX_SNAP_POINTS];
+            size_t n = layer.SnapPointsOf(e.kind, e.index, entity);
+            points.insert(points.end(), entity, entity + n);
+        }
+        layer.snaps.BulkLoad(points);
+    }
+}
+
+void CADDocument::QueryBox(const Bounds& box, std::vector<EntityRef>& out, bool visibleOnly) const {
+    for (const Layer& layer : layers) {
+        if (visibleOnly && !layer.visible) continue;
+        queryHits.clear();
+        layer.index.QueryBox(box, queryHits);
+        for (const SpatialIndex::Hit& hit : queryHits)
+            out.push_back({ layer.id, hit.kind, hit.index });
+    }
+}
+
+void CADDocument::QueryRadius(float x, float y, float radius, std::vector<EntityRef>& out, bool visibleOnly) const {
+    for (const Layer& layer : layers) {
+        if (visibleOnly && !layer.visible) continue;
+        queryHits.clear();
+        layer.index.QueryRadius(x, y, radius, queryHits);
+        for (const SpatialIndex::Hit& hit : queryHits)
+            out.push_back({ layer.id, hit.kind, hit.index });
+    }
+}
+
+bool CADDocument::Pick(float x, float y, float tolerance, EntityRef& out, bool visibleOnly) const {
+    // The index narrows millions of entities down to the few whose boxes are
+    // within reach; only those get an exact distance
+    bool found = false;
+    float best = tolerance;
+    for (const Layer& layer : layers) {
+        if (visibleOnly && !layer.visible) continue;
+        queryHits.clear();
+        layer.index.QueryRadius(x, y, tolerance, queryHits);
+        for (const SpatialIndex::Hit& hit : queryHits) {
+            float d = layer.EntityDistance(hit.kind, hit.index, x, y);
+            if (d <= best) {
+                best = d;
+                out = { layer.id, hit.kind, hit.index };
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+bool CADDocument::NearestSnapPoint(float x, float y, float tolerance, uint32_t snapMask, SnapPoint& out,
+                                   uint32_t& layerId, bool skipSelection) const {
+    if (skipSelection && selectionSkipRevision != revision) {
+        selectionSkip.resize(layers.size());
+        for (std::vector<uint64_t>& keys : selectionSkip) keys.clear();
+        for (EntityId id : selection) {
+            EntityRef ref;
+            if (!Resolve(id, ref)) continue;
+            for (size_t l = 0; l < layers.size(); l++) {
+                if (layers[l].id != ref.layerId) continue;
+                selectionSkip[l].push_back(SnapIndex::SkipKey(ref.kind, ref.index));
+                break;
+            }
+        }
+        for (std::vector<uint64_t>& keys : selectionSkip) std::sort(keys.begin(), keys.end());
+        selectionSkipRevision = revision;
+    }
+
+    bool found = false;
+    float best = tolerance;
+    for (size_t l = 0; l < layers.size(); l++) {
+        const Layer& layer = layers[l];
+        if (!layer.visible) continue;
+        SnapPoint p;
+        float d;
+        const std::vector<uint64_t>* skip = skipSelection && !selectionSkip[l].empty() ? &selectionSkip[l] : nullptr;
+        if (layer.snaps.Nearest(x, y, best, snapMask, p, d, skip)) {
+            best = d;
+            out = p;
+            layerId = layer.id;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void CADDocument::QueryNearest(float x, float y, size_t k, std::vector<EntityRef>& out, bool visibleOnly) const {
+    // k best of each layer, then the k best overall
+    std::vector<std::pair<float, EntityRef>> best;
+    for (const Layer& layer : layers) {
+        if (visibleOnly && !layer.visible) continue;
+        queryHits.clear();
+        layer.index.QueryNearest(x, y, k, queryHits);
+        for (const SpatialIndex::Hit& hit : queryHits)
+            best.push_back({ hit.distance, { layer.id, hit.kind, hit.index } });
+    }
+
+    size_t count = std::min(k, best.size());
+    std::partial_sort(best.begin(), best.begin() + count, best.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (size_t i = 0; i < count; ++i)
+        out.push_back(best[i].second);
+}
+
+Layer* CADDocument::findLayer(uint32_t layerId) {
+    for (Layer& layer : layers)
+        if (layer.id == layerId) return &layer;
+    return nullptr;
+}
+
+template <typename Modify>
+void CADDocument::editGroup(Layer& layer, EntityKind kind, const uint32_t* indices, size_t count, Modify&& modify) {
+    SnapPoint points[Layer::MAX_SNAP_POINTS];
+    for (size_t k = 0; k < count; k++) {
+        size_t n = layer.SnapPointsOf(kind, indices[k], points);
+        for (size_t p = 0; p < n; p++) layer.snaps.Remove(points[p]);
+    }
+
+    modify();
+
+    for (size_t k = 0; k < count; k++) {
+        uint32_t i = indices[k];
+        layer.index.Update(kind, i, layer.EntityBounds(kind, i));
+        size_t n = layer.SnapPointsOf(kind, i, points);
+        for (size_t p = 0; p < n; p++) layer.snaps.Insert(points[p]);
+
+        // A log longer than a fraction of the layer is slower to replay than a rebuild
+        layer.revision++;
+        size_t entities = layer.lines.Size() + layer.circles.Size() + layer.tracks.Size();
+        if (layer.edits.size() >= std::max<size_t>(4096, entities / 4)) {
+            layer.structureRevision = layer.revision;
+            layer.edits.clear();
+        } else {
+            layer.edits.push_back({ layer.revision, kind, i });
+        }
+    }
+}
+
+template <typename Modify>
+void CADDocument::editEntities(const std::vector<EntityRef>& refs, Modify&& modify) {
+    if (refs.empty()) return;
+
+    // Grouped by layer and kind so each group is one batch, and in index
+    // order so consecutive entities reach the kernels as one run
+    std::vector<EntityRef> sorted(refs);
+    std::sort(sorted.begin(), sorted.end(), [](const EntityRef& a, const EntityRef& b) {
+        return std::tie(a.layerId, a.kind, a.index) < std::tie(b.layerId, b.kind, b.index);
+    });
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    journal.BeginStep();
+    std::vector<uint32_t> indices;
+    for (size_t group = 0; group < sorted.size();) {
+        size_t end = group;
+        while (end < sorted.size() && sorted[end].layerId == sorted[group].layerId && sorted[end].kind == sorted[group].kind)
+            end++;
+        Layer* layer = findLayer(sorted[group].layerId);
+        EntityKind kind = sorted[group].kind;
+        indices.clear();
+        if (layer) {
+            size_t count = layer->Size(kind);
+            for (size_t k = group; k < end; k++)
+                if (sorted[k].index < count) indices.push_back(sorted[k].index);
+        }
+        group = end;
+        if (indices.empty()) continue;
+
+        // The values as they were, field by field
+        std::vector<float>* fields[Layer::MAX_FIELDS];
+        size_t n = layer->FieldArrays(kind, fields);
+        size_t count = indices.size();
+        EditJournal::Record* record = journal.AddRecord(EditJournal::Op::Modify, kind, layer->id, 0,
+                                                        (uint32_t)count, 1, (uint8_t)n);
+        std::copy(indices.begin(), indices.end(), record->Column(0));
+        for (size_t f = 0; f < n; f++)
+            for (size_t k = 0; k < count; k++) record->Values()[f * count + k] = (*fields[f])[indices[k]];
+
+        editGroup(*layer, kind, indices.data(), count, [&] { modify(*layer, kind, indices.data(), count); });
+    }
+    journal.EndStep();
+    revision++;
+}
+
+// Calls run(first, count) for each stretch of consecutive indices
+template <typename Run>
+static void forEachRun(const uint32_t* indices, size_t count, Run&& run) {
+    for (size_t k = 0; k < count;) {
+        size_t end = k + 1;
+        while (end < count && indices[end] == indices[end - 1] + 1) end++;
+        run(indices[k], (size_t)(end - k));
+        k = end;
+    }
+}
+
+void CADDocument::TransformEntities(const std::vector<EntityRef>& refs, const Affine2D& m) {
+    float scale = m.LengthScale();
+    editEntities(refs, [&](Layer& layer, EntityKind kind, const uint32_t* indices, size_t n) {
+        forEachRun(indices, n, [&](uint32_t first, size_t count) {
+            switch (kind) {
+            case EntityKind::Line: {
+                LineArrays& l = layer.lines;
+                SelectionKernel::TransformPoints(l.x1.data() + first, l.y1.data() + first, count, m);
+                SelectionKernel::TransformPoints(l.x2.data() + first, l.y2.data() + first, count, m);
+                break;
+            }
+            case EntityKind::Circle: {
+                CircleArrays& c = layer.circles;
+                SelectionKernel::TransformPoints(c.cx.data() + first, c.cy.data() + first, count, m);
+                if (scale != 1.0f)
+                    for (size_t i = first; i < first + count; i++) c.r[i] *= scale;
+                break;
+            }
+            case EntityKind::Track: {
+                TrackArrays& t = layer.tracks;
+                SelectionKernel::TransformPoints(t.x1.data() + first, t.y1.data() + first, count, m);
+                SelectionKernel::TransformPoints(t.x2.data() + first, t.y2.data() + first, count, m);
+                if (scale != 1.0f)
+                    for (size_t i = first; i < first + count; i++) t.width[i] *= scale;
+                break;
+            }
+            }
+        });
+    });
+}
+
+void CADDocument::TranslateEntities(const std::vector<EntityRef>& refs, float dx, float dy) {
+    if (dx == 0.0f && dy == 0.0f) return;
+    TransformEntities(refs, Affine2D::Translation(dx, dy));
+}
+
+std::vector<EntityRef> CADDocument::SelectionRefs() const {
+    std::vector<EntityRef> refs;
+    refs.reserve(selection.size());
+    for (EntityId id : selection) {
+        EntityRef ref;
+        if (Resolve(id, ref)) refs.push_back(ref);
+    }
+    return refs;
+}
+
+bool CADDocument::SelectionBounds(Bounds& out) const {
+    bool found = false;
+    const Layer* layer = nullptr;
+    for (EntityId id : selection) {
+        EntityRef ref;
+        if (!Resolve(id, ref)) continue;
+        if (!layer || layer->id != ref.layerId) layer = FindLayer(ref.layerId);
+        if (!layer) continue;
+
+        Bounds b = layer->EntityBounds(ref.kind, ref.index);
+        if (!found) {
+            out = b;
+            found = true;
+        } else {
+            out.minX = std::min(out.minX, b.minX); out.minY = std::min(out.minY, b.minY);
+            out.maxX = std::max(out.maxX, b.maxX); out.maxY = std::max(out.maxY, b.maxY);
+        }
+    }
+    return found;
+}
+
+bool CADDocument::Undo() {
+    return replay(journal.Undo(), true);
+}
+
+bool CADDocument::Redo() {
+    return replay(journal.Redo(), false);
+}
+
+// Modify records hold the other side of each change: swapping them with
+// the document takes it across the step in either direction. Inserts and
+// removes are replayed entity by entity in the opposite order on undo.
+// Each record is checked against the arrays before it is applied; one that
+// does not fit means the history no longer describes the document, which
+// is a bug. Debug builds stop there; release builds drop the history rather
+// than replay it into the wrong entities.
+bool CADDocument::replay(const std::vector<EditJournal::Record*>* records, bool undo) {
+    if (!records) return false;
+
+    bool intact = true;
+    for (size_t r = 0; r < records->size() && intact; r++) {
+        EditJournal::Record& record = *(*records)[undo ? records->size() - 1 - r : r];
+        Layer* layer = findLayer(record.layerId);
+        intact = layer && replayFits(*layer, record, undo);
+        assert(intact && "undo history does not match the document");
+        if (!intact) break;
+
+        std::vector<float>* fields[Layer::MAX_FIELDS];
+        size_t n = std::min<size_t>(layer->FieldArrays(record.kind, fields), record.fields);
+        EntityKind kind = record.kind;
+        uint32_t count = record.count;
+        float* values = record.Values();
+
+        switch (record.op) {
+        case EditJournal::Op::Modify: {
+            const uint32_t* indices = record.Column(0);
+            editGroup(*layer, kind, indices, count, [&] {
+                for (size_t f = 0; f < n; f++)
+                    for (size_t k = 0; k < count; k++) std::swap((*fields[f])[indices[k]], values[f * count + k]);
+            });
+            continue;
+        }
+        case EditJournal::Op::Insert: {
+            // Steps replay newest first, so an undone insert is always the tail of its arrays
+            uint32_t first = record.first;
+            uint32_t* slot = record.Column(0);
+            uint32_t* generation = record.Column(1);
+            if (undo) {
+                for (uint32_t k = count; k-- > 0;) {
+                    uint32_t i = first + k;
+                    slot[k] = layer->slots[(size_t)kind][i];
+                    generation[k] = slots[slot[k]].generation;
+                    for (size_t f = 0; f < n; f++) values[f * count + k] = (*fields[f])[i];
+                    removeAt(*layer, kind, i);
+                }
+            } else {
+                for (uint32_t k = 0; k < count; k++)
+                    insertAt(*layer, kind, first + k, { slot[k], generation[k] }, values + k, count);
+            }
+            break;
+        }
+        case EditJournal::Op::Remove: {
+            const uint32_t* index = record.Column(0);
+            const uint32_t* slot = record.Column(1);
+            const uint32_t* generation = record.Column(2);
+            if (undo) {
+                for (uint32_t k = count; k-- > 0;)
+                    insertAt(*layer, kind, index[k], { slot[k], generation[k] }, values + k, count);
+            } else {
+                for (uint32_t k = 0; k < count; k++) removeAt(*layer, kind, index[k]);
+            }
+            break;
+        }
+        }
+        layer->revision++;
+    }
+
+    dropStaleViewIds();
+    revision++;
+    if (!intact) journal.Clear();
+    return intact;
+}
+
+// Whether every index `record` touches is in range when it is replayed
+bool CADDocument::replayFits(const Layer& layer, const EditJournal::Record& record, bool undo) {
+    size_t size = layer.Size(record.kind);
+    uint32_t count = record.count;
+    switch (record.op) {
+    case EditJournal::Op::Modify: {
+        const uint32_t* indices = record.Column(0);
+        for (uint32_t k = 0; k < count; k++)
+            if (indices[k] >= size) return false;
+        return true;
+    }
+    case EditJournal::Op::Insert:
+        return undo ? (size_t)record.first + count == size : record.first == size;
+    case EditJournal::Op::Remove: {
+        // Undo puts them back last first, redo takes them out first first
+        const uint32_t* index = record.Column(0);
+        for (uint32_t k = 0; k < count; k++) {
+            if (undo ? index[k] > size + (count - 1 - k) : (size_t)index[k] + k >= size) return false;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+const Layer* CADDocument::FindLayer(uint32_t layerId) const {
+    for (const Layer& layer : layers)
+        if (layer.id == layerId) return &layer;
+    return nullptr;
+}
+
+void CADDocument::selectionChanged() {
+    selectionRevision++;
+    revision++;
+}
+
+void CADDocument::SetSelection(std::vector<EntityId> ids) {
+    ids.erase(std::remove_if(ids.begin(), ids.end(), [&](EntityId id) { return !Contains(id); }), ids.end());
+    selection = std::move(ids);
+    selectionChanged();
+}
+
+template <typename Classify>
+void CADDocument::selectRegion(Classify&& classify, SelectMode mode, bool additive) {
+    Containment wanted = mode == SelectMode::Window ? Containment::Inside : Containment::Crossing;
+    std::vector<EntityId> picked;
+    if (additive) picked = selection;
+
+    auto collect = [&](const Layer& layer, EntityKind kind, size_t count) {
+        const std::vector<uint32_t>& slotOf = layer.slots[(size_t)kind];
+        for (size_t i = 0; i < count; i++)
+            if (containment[i] >= wanted) picked.push_back({ slotOf[i], slots[slotOf[i]].generation });
+    };
+    for (const Layer& layer : layers) {
+        if (!layer.visible) continue;
+        size_t count = std::max({ layer.lines.Size(), layer.circles.Size(), layer.tracks.Size() });
+        if (containment.size() < count) containment.resize(count);
+
+        const LineArrays& l = layer.lines;
+        classify(SegmentSpan{ l.x1.data(), l.y1.data(), l.x2.data(), l.y2.data() }, l.Size(), containment.data());
+        collect(layer, EntityKind::Line, l.Size());
+        const CircleArrays& c = layer.circles;
+        classify(CircleSpan{ c.cx.data(), c.cy.data(), c.r.data() }, c.Size(), containment.data());
+        collect(layer, EntityKind::Circle, c.Size());
+        const TrackArrays& t = layer.tracks;
+        classify(SegmentSpan{ t.x1.data(), t.y1.data(), t.x2.data(), t.y2.data(), t.width.data() }, t.Size(),
+                 containment.data());
+        collect(layer, EntityKind::Track, t.Size());
+    }
+
+    if (additive) {
+        std::sort(picked.begin(), picked.end(), [](EntityId a, EntityId b) { return a.Key() < b.Key(); });
+        picked.erase(std::unique(picked.begin(), picked.end()), picked.end());
+    }
+    if (picked.empty() && selection.empty()) return;
+    SetSelection(std::move(picked));
+}
+
+void CADDocument::SelectInBox(const Bounds& box, SelectMode mode, bool additive) {
+    selectRegion([&](const auto& span, size_t count, Containment* out) {
+        SelectionKernel::ClassifyBox(span, count, box, out);
+    }, mode, additive);
+}
+
+void CADDocument::SelectInLasso(const std::vector<float>& xs, const std::vector<float>& ys, SelectMode mode,
+                                bool additive) {
+    size_t vertexCount = std::min(xs.size(), ys.size());
+    selectRegion([&](const auto& span, size_t count, Containment* out) {
+        SelectionKernel::ClassifyLasso(span, count, xs.data(), ys.data(), vertexCount, out);
+    }, mode, additive);
+}
+
+void CADDocument::AddToSelection(EntityId id) {
+    if (!Contains(id) || std::find(selection.begin(), selection.end(), id) != selection.end()) return;
+    selection.push_back(id);
+    selectionChanged();
+}
+
+void CADDocument::ClearSelection() {
+    if (selection.empty()) return;
+    selection.clear();
+    selectionChanged();
+}
+
+void CADDocument::SetHover(EntityId id) {
+    if (!Contains(id)) id = EntityId{};
+    if (hover == id) return;
+    hover = id;
+    selectionChanged();
+}
+
+void CADDocument::ClearHover() {
+    if (hover.IsNull()) return;
+    hover = EntityId{};
+    selectionChanged();
 }
 
 void CADDocument::AddEntityToLayer(size_t layerIndex, std::shared_ptr<Entity> entity) {
-    if (layerIndex >= layers.size()) return;
-    layers[layerIndex].entities.push_back(entity);
-}
\ No newline at end of file
+    if (!entity) return;
+
+    switch (entity->GetKind()) {
+    case EntityKind::Line: {
+        const LineEntity* line = static_cast<const LineEntity*>(entity.get());
+        AddLine(layerIndex, line->x1, line->y1, line->x2, line->y2);
+        break;
+    }
+    case EntityKind::Circle: {
+        const CircleEntity* circle = static_cast<const CircleEntity*>(entity.get());
+        AddCircle(layerIndex, circle->cx, circle->cy, circle->radius);
+        break;
+    }
+    case EntityKind::Track: {
+        const TrackEntity* track = static_cast<const TrackEntity*>(entity.get());
+        AddTrack(layerIndex, track->x1, track->y1, track->x2, track->y2, track->width);
+        break;
+    }
+    }
+}
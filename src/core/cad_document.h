@@ -3,32 +3,265 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <string>
 #include <memory>
 
-class Entity; // Forward declaration (you'll create this!)
+#include "core/affine.h"
+#include "core/edit_journal.h"
+#include "core/entity/entity.h"
+#include "core/selection_kernel.h"
+#include "core/snap_index.h"
+#include "core/spatial_index.h"
+
+// Line segments of a layer, stored as one contiguous array per coordinate
+struct LineArrays {
+    std::vector<float> x1, y1, x2, y2;
+
+    size_t Size() const { return x1.size(); }
+    void Reserve(size_t count);
+    void Add(float ax, float ay, float bx, float by);
+    void Clear();
+};
+
+// Circles of a layer, stored as one contiguous array per field
+struct CircleArrays {
+    std::vector<float> cx, cy, r;
+
+    size_t Size() const { return cx.size(); }
+    void Reserve(size_t count);
+    void Add(float x, float y, float radius);
+    void Clear();
+};
+
+// Wide track segments of a layer; width is the full copper width
+struct TrackArrays {
+    std::vector<float> x1, y1, x2, y2, width;
+
+    size_t Size() const { return x1.size(); }
+    void Reserve(size_t count);
+    void Add(float ax, float ay, float bx, float by, float w);
+    void Clear();
+};
 
 class Layer {
 public:
     std::string name;
     bool visible = true;
+    uint32_t id = 0;        // Stable across reordering, unique per document
+    uint64_t revision = 0;  // Bumped on every geometry edit
+    uint64_t structureRevision = 0;     // Last add or remove: views must rebuild the layer
+
+    // Entities whose geometry was edited in place since structureRevision,
+    // oldest first, so views can patch what they already have instead of
+    // rebuilding. Bounded: past the cap it is dropped in favour of a rebuild.
+    struct Edit {
+        uint64_t revision;  // Layer revision the edit produced
+        EntityKind kind;
+        uint32_t index;
+    };
+    std::vector<Edit> edits;
+
+    LineArrays lines;
+    CircleArrays circles;
+    TrackArrays tracks;
+    // Per kind: the EntityId slot of each entity, parallel to its arrays
+    std::vector<uint32_t> slots[3];
+
+    SpatialIndex index;     // Bounding boxes of everything above
+    SnapIndex snaps;        // Endpoints, midpoints and centers of everything above
+
+    size_t Size(EntityKind kind) const;
+    // The arrays of one kind, one per field, for code that treats entities
+    // as rows of floats (undo); returns how many were written
+    static constexpr size_t MAX_FIELDS = 5;
+    size_t FieldArrays(EntityKind kind, std::vector<float>** out);
+    size_t FieldArrays(EntityKind kind, const std::vector<float>** out) const;
+
+    Bounds EntityBounds(EntityKind kind, uint32_t i) const;
+    // Distance from (x, y) to the primitive as drawn (0 inside a track)
+    float EntityDistance(EntityKind kind, uint32_t i, float x, float y) const;
+    // Snap candidates of one entity; writes at most MAX_SNAP_POINTS
+    static constexpr size_t MAX_SNAP_POINTS = 3;
+    size_t SnapPointsOf(EntityKind kind, uint32_t i, SnapPoint* out) const;
+};
+
+// Stable handle to an entity, issued by CADDocument: a slot in the
+// document's slot table and the generation the slot had when issued. It
+// survives edits, layer reordering, deletes of other entities and undo.
+// When its entity is deleted it goes stale, and it never resolves to
+// whatever reuses the slot later.
+struct EntityId {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool IsNull() const { return slot == UINT32_MAX; }
+    uint64_t Key() const { return ((uint64_t)generation << 32) | slot; }   // For hashing and ordering
+    bool operator==(const EntityId& o) const { return slot == o.slot && generation == o.generation; }
+    bool operator!=(const EntityId& o) const { return !(*this == o); }
+};
+
+// Where a primitive of the document is right now: the layer's stable id,
+// which array it lives in and its index there. Deletes move entities
+// within their arrays, so anything kept across edits should hold an
+// EntityId and resolve it when needed.
+struct EntityRef {
+    uint32_t layerId = 0;
+    EntityKind kind = EntityKind::Line;
+    uint32_t index = 0;
 
-    std::vector<std::shared_ptr<Entity>> entities;
+    bool operator==(const EntityRef& o) const { return layerId == o.layerId && kind == o.kind && index == o.index; }
+    bool operator!=(const EntityRef& o) const { return !(*this == o); }
 };
 
+// Window takes only entities entirely inside the region; Crossing also
+// takes those that touch it
+enum class SelectMode { Window, Crossing };
+
 class CADDocument {
 public:
     CADDocument();
 
     void AddLayer(const std::string& name);
+    void SetLayerVisible(size_t layerIndex, bool visible);
+    void MoveLayer(size_t from, size_t to);    // Layers draw in index order
+    // Each returns the new entity's handle, or a null id for a bad layer
+    EntityId AddLine(size_t layerIndex, float x1, float y1, float x2, float y2);
+    EntityId AddCircle(size_t layerIndex, float cx, float cy, float radius);
+    EntityId AddTrack(size_t layerIndex, float x1, float y1, float x2, float y2, float width);
+
+    // Compatibility wrapper: copies the entity's geometry into the layer's arrays
     void AddEntityToLayer(size_t layerIndex, std::shared_ptr<Entity> entity);
 
     const std::vector<Layer>& GetLayers() const { return layers; }
 
+    // Handles to and from positions, both O(1). The layer arrays stay dense,
+    // so iterating them with IdOf visits every live entity once.
+    EntityId IdOf(const EntityRef& ref) const;
+    bool Resolve(EntityId id, EntityRef& out) const;    // False for null and stale ids
+    bool Contains(EntityId id) const { EntityRef ref; return Resolve(id, ref); }
+    size_t EntityCount() const { return slots.size() - freeSlots.size(); }
+
+    // Deletes as one undo step, skipping stale ids. The last entity of each
+    // array moves into the freed place.
+    void DeleteEntities(const std::vector<EntityId>& ids);
+
+    // Bumped by every change to the document, including visibility and layer order
+    uint64_t GetRevision() const { return revision; }
+
+    // Selection and hover are view state: they never touch layer geometry.
+    // Being EntityIds they follow entities that move; deleted ones drop out.
+    void SetSelection(std::vector<EntityId> ids);
+    void AddToSelection(EntityId id);
+    void ClearSelection();
+    const std::vector<EntityId>& GetSelection() const { return selection; }
+    // Where the selected entities are now, for the edits that take refs
+    std::vector<EntityRef> SelectionRefs() const;
+    // Union of the selected entities' boxes; false when nothing is selected
+    bool SelectionBounds(Bounds& out) const;
+    void SetHover(EntityId id);
+    void ClearHover();
+    EntityId GetHover() const { return hover; }     // Null when nothing is hovered
+    uint64_t GetSelectionRevision() const { return selectionRevision; }
+    // Rubber band and lasso over visible layers; additive keeps the current selection
+    void SelectInBox(const Bounds& box, SelectMode mode, bool additive);
+    void SelectInLasso(const std::vector<float>& xs, const std::vector<float>& ys, SelectMode mode, bool additive);
+    const Layer* FindLayer(uint32_t layerId) const;
+
+    // Adding many entities (file open, generators): indexes are built once
+    // at the end instead of per entity
+    void BeginBulkLoad();
+    void EndBulkLoad();
+
+    // Spatial queries across layers, by entity bounding box
+    void QueryBox(const Bounds& box, std::vector<EntityRef>& out, bool visibleOnly = false) const;
+    void QueryRadius(float x, float y, float radius, std::vector<EntityRef>& out, bool visibleOnly = false) const;
+    void QueryNearest(float x, float y, size_t k, std::vector<EntityRef>& out, bool visibleOnly = false) const;
+
+    // Closest entity whose drawn outline is within `tolerance` of (x, y),
+    // measured on the real geometry. Later layers win ties, as they draw on top.
+    bool Pick(float x, float y, float tolerance, EntityRef& out, bool visibleOnly = true) const;
+
+    // Nearest snap candidate of an enabled kind on a visible layer. With
+    // skipSelection the selected entities' own points are passed over, so
+    // something being dragged does not snap to itself.
+    bool NearestSnapPoint(float x, float y, float tolerance, uint32_t snapMask, SnapPoint& out, uint32_t& layerId,
+                          bool skipSelection = false) const;
+
+    // Maps entities through `m` with the batch kernels, keeping the indexes
+    // in step and logging each as an in-place edit. Radii and track widths
+    // scale by m.LengthScale(), so `m` should not skew or stretch.
+    void TransformEntities(const std::vector<EntityRef>& refs, const Affine2D& m);
+    void TranslateEntities(const std::vector<EntityRef>& refs, float dx, float dy);
+
+    // Every Add, Delete and Transform outside a bulk load is one undo step. Undo and
+    // redo cost the size of the step, and edits in place reach views through
+    // the layer edit log like any other edit, and entities brought back keep
+    // their EntityIds. A bulk load clears the history. Undo and Redo return
+    // false with nothing to do, and also after dropping a history that no
+    // longer fits the document.
+    bool CanUndo() const { return journal.CanUndo(); }
+    bool CanRedo() const { return journal.CanRedo(); }
+    bool Undo();
+    bool Redo();
+    void ClearHistory() { journal.Clear(); }
+    // Oldest steps are dropped past this many bytes of history
+    void SetUndoLimit(size_t bytes) { journal.SetCapacity(bytes); }
+    size_t UndoMemoryUsed() const { return journal.MemoryUsed(); }
+
     // Future:
     // void Save(const std::string& path);
     // void Load(const std::string& path);
 
 private:
     std::vector<Layer> layers;
+    uint32_t nextLayerId = 0;
+    uint64_t revision = 0;
+    bool bulkLoading = false;
+    mutable std::vector<SpatialIndex::Hit> queryHits;   // Scratch, reused across queries
+    // SnapIndex::SkipKey of the selected entities, sorted, per layer position;
+    // rebuilt when the revision moves on
+    mutable std::vector<std::vector<uint64_t>> selectionSkip;
+    mutable uint64_t selectionSkipRevision = UINT64_MAX;
+
+    std::vector<EntityId> selection;
+    EntityId hover;
+    uint64_t selectionRevision = 0;
+    std::vector<Containment> containment;   // Scratch for region selection
+    EditJournal journal;
+
+    struct Slot {
+        uint32_t layerId = 0;
+        uint32_t index = 0;
+        uint32_t generation = 0;        // Of the entity holding the slot, or the last one that did
+        uint32_t nextGeneration = 0;    // Never issued from this slot yet
+        EntityKind kind = EntityKind::Line;
+        bool live = false;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+    void dropStaleViewIds();    // After changes that delete entities
+    void selectionChanged();
+    void indexEntity(Layer& layer, EntityKind kind, uint32_t i);
+    void unindexEntity(Layer& layer, EntityKind kind, uint32_t i);
+    EntityId issueId(Layer& layer, EntityKind kind);    // For an entity just appended
+    void reviveId(EntityId id, Layer& layer, EntityKind kind, uint32_t index);
+    // Swap-with-last removal and its exact inverse; both keep the indexes
+    // and slot table in step. `values` holds one value per field, `stride` apart.
+    void removeAt(Layer& layer, EntityKind kind, uint32_t index);
+    void insertAt(Layer& layer, EntityKind kind, uint32_t index, EntityId id, const float* values, size_t stride);
+    Layer* findLayer(uint32_t layerId);
+    void recordInsert(Layer& layer, EntityKind kind, uint32_t index);
+    // Calls modify(layer, kind, indices, count) once per layer and kind, with
+    // the entities' indices sorted and deduplicated, between unindexing and
+    // reindexing them; the values they had are journaled as one undo step
+    template <typename Modify>
+    void editEntities(const std::vector<EntityRef>& refs, Modify&& modify);
+    template <typename Modify>
+    void editGroup(Layer& layer, EntityKind kind, const uint32_t* indices, size_t count, Modify&& modify);
+    bool replay(const std::vector<EditJournal::Record*>* records, bool undo);
+    static bool replayFits(const Layer& layer, const EditJournal::Record& record, bool undo);
+    template <typename Classify>
+    void selectRegion(Classify&& classify, SelectMode mode, bool additive);
 };
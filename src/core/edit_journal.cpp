@@ -0,0 +1,107 @@
+// edit_journal.cpp
+
+#include "edit_journal.h"
+
+#include <algorithm>
+
+void* EditJournal::allocate(size_t bytes) {
+    bytes = (bytes + 7) & ~size_t(7);
+    if (blocks.empty() || blocks.back().used + bytes > blocks.back().size) {
+        size_t size = std::max(BLOCK_SIZE, bytes);
+        blocks.push_back({ std::make_unique<uint8_t[]>(size), size, 0 });
+        allocated += size;
+    }
+    Block& block = blocks.back();
+    void* p = block.data.get() + block.used;
+    block.used += bytes;
+    return p;
+}
+
+void EditJournal::BeginStep() {
+    while (steps.size() > cursor) dropNewest();
+    uint64_t block = firstBlock + blocks.size();
+    size_t offset = 0;
+    if (!blocks.empty()) {
+        block--;
+        offset = blocks.back().used;
+    }
+    steps.push_back({ {}, block, offset });
+    recording = true;
+}
+
+EditJournal::Record* EditJournal::AddRecord(Op op, EntityKind kind, uint32_t layerId, uint32_t first,
+                                            uint32_t count, uint8_t columns, uint8_t fields) {
+    if (!recording) return nullptr;
+    static_assert(sizeof(uint32_t) == sizeof(float), "columns and values share a stride");
+    size_t payload = ((size_t)columns + fields) * count * sizeof(float);
+    Record* record = static_cast<Record*>(allocate(sizeof(Record) + payload));
+    *record = { op, kind, columns, fields, layerId, first, count };
+    steps.back().records.push_back(record);
+    return record;
+}
+
+void EditJournal::EndStep() {
+    if (!recording) return;
+    recording = false;
+    if (steps.back().records.empty()) {
+        dropNewest();
+        return;
+    }
+    cursor = steps.size();
+    enforceCapacity();
+}
+
+const std::vector<EditJournal::Record*>* EditJournal::Undo() {
+    if (recording || cursor == 0) return nullptr;
+    return &steps[--cursor].records;
+}
+
+const std::vector<EditJournal::Record*>* EditJournal::Redo() {
+    if (recording || cursor == steps.size()) return nullptr;
+    return &steps[cursor++].records;
+}
+
+void EditJournal::Clear() {
+    steps.clear();
+    blocks.clear();
+    firstBlock = 0;
+    allocated = 0;
+    cursor = 0;
+    recording = false;
+}
+
+void EditJournal::SetCapacity(size_t bytes) {
+    capacity = bytes;
+    if (!recording) enforceCapacity();
+}
+
+// Frees the blocks that only the oldest step used
+void EditJournal::dropOldest() {
+    steps.pop_front();
+    if (cursor > 0) cursor--;
+    uint64_t keep = steps.empty() ? firstBlock + blocks.size() : steps.front().block;
+    while (firstBlock < keep && !blocks.empty()) {
+        allocated -= blocks.front().size;
+        blocks.pop_front();
+        firstBlock++;
+    }
+}
+
+// Rewinds the arena to where the newest step began
+void EditJournal::dropNewest() {
+    const Step& step = steps.back();
+    while (!blocks.empty() && firstBlock + blocks.size() - 1 > step.block) {
+        allocated -= blocks.back().size;
+        blocks.pop_back();
+    }
+    if (!blocks.empty() && firstBlock + blocks.size() - 1 == step.block) blocks.back().used = step.offset;
+    steps.pop_back();
+    cursor = std::min(cursor, steps.size());
+}
+
+// A step that alone exceeds the cap cannot be kept, and older steps cannot
+// be undone across it, so the history is emptied
+void EditJournal::enforceCapacity() {
+    while (allocated > capacity && steps.size() > 1) dropOldest();
+    if (allocated > capacity) Clear();
+}
@@ -0,0 +1,96 @@
+// edit_journal.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "core/entity/entity.h"
+
+// Undo history as compact deltas. A step is one user action: a list of
+// records, each covering entities of one kind on one layer. Records are
+// packed into blocks of an arena that grows as a queue at the front (the
+// oldest steps are dropped to stay under the memory cap) and as a stack at
+// the back (a new step drops everything that could have been redone).
+//
+// The journal does not interpret the values it holds. CADDocument stores
+// each entity field by field and swaps them with the document on undo and
+// redo, so one copy serves both directions.
+class EditJournal {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64u << 20;
+
+    enum class Op : uint8_t {
+        Insert,     // Entities [first, first + count) were appended
+        Modify,     // Entities at the indices in column 0 were edited in place
+        Remove,     // Entities were deleted in order, each swapped with the last
+    };
+
+    // Header of one delta. `columns` arrays of count integers follow it,
+    // then `fields` arrays of count values; what they mean is up to the
+    // document.
+    struct Record {
+        Op op;
+        EntityKind kind;
+        uint8_t columns;
+        uint8_t fields;
+        uint32_t layerId;
+        uint32_t first;     // Insert only
+        uint32_t count;
+
+        uint32_t* Column(size_t c) { return reinterpret_cast<uint32_t*>(this + 1) + c * count; }
+        const uint32_t* Column(size_t c) const { return reinterpret_cast<const uint32_t*>(this + 1) + c * count; }
+        // count values of the first field, then count of the next, and so on
+        float* Values() { return reinterpret_cast<float*>(Column(columns)); }
+    };
+
+    explicit EditJournal(size_t capacityBytes = DEFAULT_CAPACITY) : capacity(capacityBytes) {}
+
+    // Steps are recorded between these; an empty step leaves no trace
+    void BeginStep();
+    Record* AddRecord(Op op, EntityKind kind, uint32_t layerId, uint32_t first, uint32_t count,
+                      uint8_t columns, uint8_t fields);
+    void EndStep();
+
+    bool CanUndo() const { return cursor > 0; }
+    bool CanRedo() const { return cursor < steps.size(); }
+    // Records of the step to replay, in recording order, or null; moves the cursor
+    const std::vector<Record*>* Undo();
+    const std::vector<Record*>* Redo();
+
+    void Clear();
+    void SetCapacity(size_t bytes);
+    size_t MemoryUsed() const { return allocated; }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64u << 10;
+
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+        size_t used;
+    };
+
+    // Where a step's first record went, so dropping it can free what follows
+    struct Step {
+        std::vector<Record*> records;
+        uint64_t block;     // Sequence number of the block it starts in
+        size_t offset;
+    };
+
+    void* allocate(size_t bytes);
+    void dropOldest();
+    void dropNewest();
+    void enforceCapacity();
+
+    size_t capacity;
+    size_t allocated = 0;
+    std::deque<Block> blocks;
+    uint64_t firstBlock = 0;    // Sequence number of blocks.front()
+    std::deque<Step> steps;
+    size_t cursor = 0;          // steps[0, cursor) can be undone, the rest redone
+    bool recording = false;
+};
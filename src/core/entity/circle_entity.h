@@ -10,7 +10,7 @@ public:
     float radius;    // Radius
 
     CircleEntity(float cx_, float cy_, float radius_)
-        : cx(cx_), cy(cy_), radius(radius_) {}
+        : Entity(EntityKind::Circle), cx(cx_), cy(cy_), radius(radius_) {}
 
     std::string GetType() const override { return "Circle"; }
 
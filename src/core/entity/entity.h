@@ -3,10 +3,26 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
+
+// Compact type tag so hot paths can dispatch without strings or RTTI
+enum class EntityKind : uint8_t {
+    Line,
+    Circle,
+    Track,
+};
 
 class Entity {
 public:
     virtual ~Entity() = default;
 
     virtual std::string GetType() const = 0;  // <--- THIS MUST EXIST!
+
+    EntityKind GetKind() const { return kind; }
+
+protected:
+    explicit Entity(EntityKind kind_) : kind(kind_) {}
+
+private:
+    EntityKind kind;
 };
@@ -0,0 +1,17 @@
+// track_entity.h
+
+#pragma once
+
+#include "entity.h"
+
+// Copper track segment: a line with a width and round caps
+class TrackEntity : public Entity {
+public:
+    float x1, y1, x2, y2;
+    float width;
+
+    TrackEntity(float x1_, float y1_, float x2_, float y2_, float width_)
+        : Entity(EntityKind::Track), x1(x1_), y1(y1_), x2(x2_), y2(y2_), width(width_) {}
+
+    std::string GetType() const override { return "Track"; }
+};
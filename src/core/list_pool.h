@@ -0,0 +1,106 @@
+// list_pool.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Many short lists (the cells of a grid index) stored back to back in one
+// array instead of one heap block each. A bulk load gives every list its
+// exact room up front, so a whole index is a handful of allocations and
+// is freed in one step. A list that outgrows its room later moves to the
+// end of the array with twice the room; the space it leaves behind is
+// reclaimed by Compact, which the owner runs when NeedsCompaction says so.
+// T must be trivially copyable.
+template <typename T>
+class ListPool {
+public:
+    struct List {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        uint32_t capacity = 0;
+    };
+
+    struct View {
+        const T* first;
+        const T* last;
+        const T* begin() const { return first; }
+        const T* end() const { return last; }
+    };
+
+    void Clear() {
+        data.clear();
+        wasted = 0;
+    }
+
+    // Room for this many entries in total, before lists are laid out
+    void ReserveTotal(size_t count) { data.reserve(count); }
+
+    // Gives an empty list room for `count` entries at the end of the pool
+    void Reserve(List& list, uint32_t count) {
+        wasted += list.capacity;
+        list = { (uint32_t)data.size(), 0, count };
+        data.resize(data.size() + count);
+    }
+
+    void Push(List& list, const T& value) {
+        if (list.size == list.capacity) grow(list);
+        data[list.offset + list.size++] = value;
+    }
+
+    T& At(const List& list, uint32_t i) { return data[list.offset + i]; }
+    const T& At(const List& list, uint32_t i) const { return data[list.offset + i]; }
+    T& Back(const List& list) { return data[list.offset + list.size - 1]; }
+    void PopBack(List& list) { list.size--; }
+
+    // For a list that is being dropped; its room becomes garbage
+    void Release(List& list) {
+        wasted += list.capacity;
+        list = {};
+    }
+
+    View Items(const List& list) const {
+        const T* first = data.data() + list.offset;
+        return { first, first + list.size };
+    }
+
+    bool NeedsCompaction() const { return wasted > 4096 && wasted > data.size() / 2; }
+
+    // Packs the lists visited by forEachList(fn), calling fn(List&) for
+    // each; every live list must be visited
+    template <typename ForEachList>
+    void Compact(ForEachList&& forEachList) {
+        std::vector<T> packed;
+        packed.reserve(data.size() - wasted);
+        forEachList([&](List& list) {
+            uint32_t offset = (uint32_t)packed.size();
+            packed.insert(packed.end(), data.begin() + list.offset, data.begin() + list.offset + list.size);
+            list = { offset, list.size, list.size };
+        });
+        data.swap(packed);
+        wasted = 0;
+    }
+
+    size_t Capacity() const { return data.size(); }
+
+private:
+    void grow(List& list) {
+        uint32_t room = list.capacity ? list.capacity * 2 : 2;
+        // The last list in the array can grow where it is
+        if (list.offset + list.capacity == data.size() && list.capacity) {
+            data.resize(data.size() + (room - list.capacity));
+            list.capacity = room;
+            return;
+        }
+        uint32_t offset = (uint32_t)data.size();
+        data.resize(data.size() + room);
+        for (uint32_t i = 0; i < list.size; i++) data[offset + i] = data[list.offset + i];
+        wasted += list.capacity;
+        list.offset = offset;
+        list.capacity = room;
+    }
+
+    std::vector<T> data;
+    size_t wasted = 0;  // Entries no list owns any more
+};
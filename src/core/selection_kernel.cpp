@@ -0,0 +1,134 @@
+// selection_kernel.cpp
+
+#include "core/selection_kernel.h"
+#include "core/selection_kernel_impl.h"
+#include "core/affine.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(SELECTION_KERNEL_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+const SelectionKernel::detail::Kernels SelectionKernel::detail::scalarKernels = makeKernels<ScalarOps>();
+
+namespace SelectionKernel {
+
+    static Isa detectIsa() {
+#ifdef SELECTION_KERNEL_X86
+#if defined(_MSC_VER)
+        // AVX2 needs both the CPU feature and OS support for saving YMM state
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] >= 7) {
+            __cpuidex(info, 7, 0);
+            bool avx2 = (info[1] & (1 << 5)) != 0;
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            if (avx2 && osxsave && (_xgetbv(0) & 6) == 6 && detail::avx2Kernels) return Isa::Avx2;
+        }
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && detail::avx2Kernels) return Isa::Avx2;
+#endif
+        if (detail::sseKernels) return Isa::Sse;
+#endif
+        return Isa::Scalar;
+    }
+
+    static Isa bestIsa() {
+        static const Isa best = detectIsa();
+        return best;
+    }
+
+    static Isa& activeIsa() {
+        static Isa isa = bestIsa();
+        return isa;
+    }
+
+    static const detail::Kernels& kernels() {
+        switch (activeIsa()) {
+        case Isa::Avx2: return *detail::avx2Kernels;
+        case Isa::Sse: return *detail::sseKernels;
+        default: return detail::scalarKernels;
+        }
+    }
+
+    Isa GetIsa() {
+        return activeIsa();
+    }
+
+    void SetIsa(Isa isa) {
+        activeIsa() = std::min(isa, bestIsa());
+    }
+
+    const char* IsaName(Isa isa) {
+        switch (isa) {
+        case Isa::Avx2: return "AVX2";
+        case Isa::Sse: return "SSE";
+        default: return "scalar";
+        }
+    }
+
+    // Edge table of a closed polygon, in the form the lasso kernels consume
+    struct LassoTable {
+        std::vector<float> ax, ay, bx, by, slope, invLen2;
+        detail::LassoEdges edges{};
+
+        LassoTable(const float* xs, const float* ys, size_t count) {
+            edges.bounds = { xs[0], ys[0], xs[0], ys[0] };
+            for (size_t i = 0; i < count; i++) {
+                size_t j = (i + 1) % count;
+                float dx = xs[j] - xs[i], dy = ys[j] - ys[i];
+                float len2 = dx * dx + dy * dy;
+                ax.push_back(xs[i]); ay.push_back(ys[i]);
+                bx.push_back(xs[j]); by.push_back(ys[j]);
+                slope.push_back(dy != 0.0f ? dx / dy : 0.0f);
+                invLen2.push_back(len2 > 0.0f ? 1.0f / len2 : 0.0f);
+                edges.bounds.minX = std::min(edges.bounds.minX, xs[i]);
+                edges.bounds.minY = std::min(edges.bounds.minY, ys[i]);
+                edges.bounds.maxX = std::max(edges.bounds.maxX, xs[i]);
+                edges.bounds.maxY = std::max(edges.bounds.maxY, ys[i]);
+            }
+            edges.ax = ax.data(); edges.ay = ay.data();
+            edges.bx = bx.data(); edges.by = by.data();
+            edges.slope = slope.data();
+            edges.invLen2 = invLen2.data();
+            edges.count = count;
+        }
+    };
+
+    void ClassifyBox(const SegmentSpan& segments, size_t count, const Bounds& box, Containment* out) {
+        kernels().segmentsBox(segments, 0, count, box, out);
+    }
+
+    void ClassifyBox(const CircleSpan& circles, size_t count, const Bounds& box, Containment* out) {
+        kernels().circlesBox(circles, 0, count, box, out);
+    }
+
+    void ClassifyLasso(const SegmentSpan& segments, size_t count,
+                       const float* xs, const float* ys, size_t vertexCount, Containment* out) {
+        if (vertexCount < 3) {
+            std::fill(out, out + count, Containment::Outside);
+            return;
+        }
+        LassoTable table(xs, ys, vertexCount);
+        kernels().segmentsLasso(segments, 0, count, table.edges, out);
+    }
+
+    void ClassifyLasso(const CircleSpan& circles, size_t count,
+                       const float* xs, const float* ys, size_t vertexCount, Containment* out) {
+        if (vertexCount < 3) {
+            std::fill(out, out + count, Containment::Outside);
+            return;
+        }
+        LassoTable table(xs, ys, vertexCount);
+        kernels().circlesLasso(circles, 0, count, table.edges, out);
+    }
+
+    void TransformPoints(float* xs, float* ys, size_t count, const Affine2D& m) {
+        kernels().transformPoints(xs, ys, 0, count, detail::Affine{ m.a, m.b, m.c, m.d, m.tx, m.ty });
+    }
+}
@@ -0,0 +1,56 @@
+// selection_kernel.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "core/bounds.h"
+
+struct Affine2D;    // core/affine.h
+
+// How an entity relates to a selection region
+enum class Containment : uint8_t { Outside = 0, Crossing = 1, Inside = 2 };
+
+// Segments as one array per coordinate. Width is optional (tracks); when
+// set, box tests use the segment's footprint rather than its centerline.
+struct SegmentSpan {
+    const float* x1;
+    const float* y1;
+    const float* x2;
+    const float* y2;
+    const float* width = nullptr;
+};
+
+// Circles are classified by their outline, which is what is drawn
+struct CircleSpan {
+    const float* cx;
+    const float* cy;
+    const float* r;
+};
+
+// Batch classification of entities against a selection box or lasso, and
+// the batch transform the edit tools apply to what was selected. Each
+// kernel exists in scalar, SSE and AVX2 form; the widest one the CPU
+// supports is picked on first use.
+namespace SelectionKernel {
+    enum class Isa { Scalar, Sse, Avx2 };
+
+    Isa GetIsa();
+    // Forces a narrower instruction set (benchmarks); clamped to what the CPU supports
+    void SetIsa(Isa isa);
+    const char* IsaName(Isa isa);
+
+    void ClassifyBox(const SegmentSpan& segments, size_t count, const Bounds& box, Containment* out);
+    void ClassifyBox(const CircleSpan& circles, size_t count, const Bounds& box, Containment* out);
+
+    // The lasso is a closed polygon (last vertex joins the first); self
+    // intersections follow the even-odd rule. Track widths are ignored here.
+    void ClassifyLasso(const SegmentSpan& segments, size_t count,
+                       const float* xs, const float* ys, size_t vertexCount, Containment* out);
+    void ClassifyLasso(const CircleSpan& circles, size_t count,
+                       const float* xs, const float* ys, size_t vertexCount, Containment* out);
+
+    // Maps points (xs[i], ys[i]) through `m` in place
+    void TransformPoints(float* xs, float* ys, size_t count, const Affine2D& m);
+}
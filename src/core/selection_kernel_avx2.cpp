@@ -0,0 +1,50 @@
+// selection_kernel_avx2.cpp
+
+// Built with AVX2 enabled (see CMakeLists.txt) and only called after a
+// runtime CPU check, so nothing outside this file may be compiled with it.
+// Only include headers that are safe for that (see selection_kernel_impl.h).
+
+#include "core/selection_kernel_impl.h"
+
+#if defined(SELECTION_KERNEL_X86) && (defined(__AVX2__) || defined(_MSC_VER))
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2Ops {
+    using F = __m256;
+    using M = __m256;
+    static constexpr size_t WIDTH = 8;
+
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+    static F set(float v) { return _mm256_set1_ps(v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M ge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static M none() { return _mm256_setzero_ps(); }
+    static M and_(M a, M b) { return _mm256_and_ps(a, b); }
+    static M or_(M a, M b) { return _mm256_or_ps(a, b); }
+    static M xor_(M a, M b) { return _mm256_xor_ps(a, b); }
+    static M andNot(M a, M b) { return _mm256_andnot_ps(b, a); }
+    static unsigned bits(M m) { return (unsigned)_mm256_movemask_ps(m); }
+};
+
+constexpr SelectionKernel::detail::Kernels avx2Table = makeKernels<Avx2Ops>();
+
+}
+
+const SelectionKernel::detail::Kernels* const SelectionKernel::detail::avx2Kernels = &avx2Table;
+
+#else
+
+const SelectionKernel::detail::Kernels* const SelectionKernel::detail::avx2Kernels = nullptr;
+
+#endif
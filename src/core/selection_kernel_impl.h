@@ -0,0 +1,299 @@
+// selection_kernel_impl.h
+
+#pragma once
+
+// Kernel bodies shared by the per-instruction-set translation units. Each
+// kernel is written once against a small vector-ops type (ScalarOps here,
+// SseOps and Avx2Ops in their own files). Everything below the detail
+// declarations has internal linkage, so code compiled for AVX2 can never be
+// picked by the linker for a caller running on an older CPU. For the same
+// reason, only include headers here that define types and macros, never
+// inline functions.
+
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+
+#include "core/selection_kernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SELECTION_KERNEL_X86 1
+#endif
+
+namespace SelectionKernel {
+namespace detail {
+
+    // Lasso edges in SoA form, prepared once per query
+    struct LassoEdges {
+        const float* ax;
+        const float* ay;
+        const float* bx;
+        const float* by;
+        const float* slope;     // dx / dy for the crossing-number test, 0 for horizontal edges
+        const float* invLen2;   // 1 / |b - a|^2, 0 for degenerate edges
+        size_t count;
+        Bounds bounds;
+    };
+
+    // Plain copy of an Affine2D; affine.h has inline functions, so it stays out of here
+    struct Affine {
+        float a, b, c, d, tx, ty;
+    };
+
+    // One instruction set's kernels; each handles entities [begin, end)
+    struct Kernels {
+        void (*segmentsBox)(const SegmentSpan&, size_t begin, size_t end, const Bounds&, Containment*);
+        void (*circlesBox)(const CircleSpan&, size_t begin, size_t end, const Bounds&, Containment*);
+        void (*segmentsLasso)(const SegmentSpan&, size_t begin, size_t end, const LassoEdges&, Containment*);
+        void (*circlesLasso)(const CircleSpan&, size_t begin, size_t end, const LassoEdges&, Containment*);
+        void (*transformPoints)(float* xs, float* ys, size_t begin, size_t end, const Affine&);
+    };
+
+    extern const Kernels scalarKernels;
+    // Null when the build could not compile that instruction set
+    extern const Kernels* const sseKernels;
+    extern const Kernels* const avx2Kernels;
+}
+}
+
+namespace {
+
+using SelectionKernel::detail::Affine;
+using SelectionKernel::detail::LassoEdges;
+
+// One lane; also used for the tail of every vector loop
+struct ScalarOps {
+    using F = float;
+    using M = bool;
+    static constexpr size_t WIDTH = 1;
+
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F v) { *p = v; }
+    static F set(float v) { return v; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F min(F a, F b) { return a < b ? a : b; }
+    static F max(F a, F b) { return a > b ? a : b; }
+    static M lt(F a, F b) { return a < b; }
+    static M le(F a, F b) { return a <= b; }
+    static M gt(F a, F b) { return a > b; }
+    static M ge(F a, F b) { return a >= b; }
+    static M none() { return false; }
+    static M and_(M a, M b) { return a && b; }
+    static M or_(M a, M b) { return a || b; }
+    static M xor_(M a, M b) { return a != b; }
+    static M andNot(M a, M b) { return a && !b; }   // a & ~b
+    static unsigned bits(M m) { return m ? 1u : 0u; }
+};
+
+// Inside implies touching, so the code is Inside, Crossing or Outside in that order
+template <typename V>
+inline void store(Containment* out, typename V::M inside, typename V::M touch) {
+    unsigned in = V::bits(inside), t = V::bits(touch);
+    for (size_t l = 0; l < V::WIDTH; l++)
+        out[l] = ((in >> l) & 1) ? Containment::Inside : ((t >> l) & 1) ? Containment::Crossing : Containment::Outside;
+}
+
+template <typename V, typename Block>
+inline void forEachBlock(size_t begin, size_t end, Block&& block) {
+    size_t i = begin;
+    for (; i + V::WIDTH <= end; i += V::WIDTH) block(V{}, i);
+    for (; i < end; i++) block(ScalarOps{}, i);
+}
+
+template <typename V>
+inline typename V::M boxesOverlap(typename V::F minX, typename V::F minY, typename V::F maxX, typename V::F maxY,
+                                  const Bounds& b) {
+    return V::and_(V::and_(V::ge(maxX, V::set(b.minX)), V::le(minX, V::set(b.maxX))),
+                   V::and_(V::ge(maxY, V::set(b.minY)), V::le(minY, V::set(b.maxY))));
+}
+
+template <typename V>
+void segmentsBoxBlock(const SegmentSpan& s, size_t i, const Bounds& box, Containment* out) {
+    using F = typename V::F;
+    using M = typename V::M;
+    F x1 = V::load(s.x1 + i), y1 = V::load(s.y1 + i);
+    F x2 = V::load(s.x2 + i), y2 = V::load(s.y2 + i);
+    F pad = s.width ? V::mul(V::load(s.width + i), V::set(0.5f)) : V::set(0.0f);
+    F minX = V::min(x1, x2), maxX = V::max(x1, x2);
+    F minY = V::min(y1, y2), maxY = V::max(y1, y2);
+
+    // Footprint box of the segment inside the selection
+    F bx0 = V::set(box.minX), bx1 = V::set(box.maxX);
+    F by0 = V::set(box.minY), by1 = V::set(box.maxY);
+    M inside = V::and_(V::and_(V::ge(V::sub(minX, pad), bx0), V::le(V::add(maxX, pad), bx1)),
+                       V::and_(V::ge(V::sub(minY, pad), by0), V::le(V::add(maxY, pad), by1)));
+
+    // Against the selection grown by the half width: exact for lines,
+    // slightly generous at the corners for tracks
+    F ex0 = V::sub(bx0, pad), ex1 = V::add(bx1, pad);
+    F ey0 = V::sub(by0, pad), ey1 = V::add(by1, pad);
+    M overlap = V::and_(V::and_(V::ge(maxX, ex0), V::le(minX, ex1)),
+                        V::and_(V::ge(maxY, ey0), V::le(minY, ey1)));
+
+    // With overlapping boxes, the segment misses only if all four corners
+    // lie strictly on one side of its line
+    F dx = V::sub(x2, x1), dy = V::sub(y2, y1);
+    F rx0 = V::sub(ex0, x1), rx1 = V::sub(ex1, x1);
+    F ry0 = V::sub(ey0, y1), ry1 = V::sub(ey1, y1);
+    F s00 = V::sub(V::mul(dx, ry0), V::mul(dy, rx0));
+    F s01 = V::sub(V::mul(dx, ry1), V::mul(dy, rx0));
+    F s10 = V::sub(V::mul(dx, ry0), V::mul(dy, rx1));
+    F s11 = V::sub(V::mul(dx, ry1), V::mul(dy, rx1));
+    F zero = V::set(0.0f);
+    M above = V::and_(V::and_(V::gt(s00, zero), V::gt(s01, zero)), V::and_(V::gt(s10, zero), V::gt(s11, zero)));
+    M below = V::and_(V::and_(V::lt(s00, zero), V::lt(s01, zero)), V::and_(V::lt(s10, zero), V::lt(s11, zero)));
+    M touch = V::andNot(overlap, V::or_(above, below));
+
+    store<V>(out + i, inside, touch);
+}
+
+template <typename V>
+void circlesBoxBlock(const CircleSpan& c, size_t i, const Bounds& box, Containment* out) {
+    using F = typename V::F;
+    using M = typename V::M;
+    F cx = V::load(c.cx + i), cy = V::load(c.cy + i), r = V::load(c.r + i);
+    F bx0 = V::set(box.minX), bx1 = V::set(box.maxX);
+    F by0 = V::set(box.minY), by1 = V::set(box.maxY);
+
+    M inside = V::and_(V::and_(V::ge(V::sub(cx, r), bx0), V::le(V::add(cx, r), bx1)),
+                       V::and_(V::ge(V::sub(cy, r), by0), V::le(V::add(cy, r), by1)));
+
+    // The outline meets the box when the nearest point of the box is within
+    // the circle and the farthest is not
+    F zero = V::set(0.0f);
+    F nx = V::max(V::max(V::sub(bx0, cx), V::sub(cx, bx1)), zero);
+    F ny = V::max(V::max(V::sub(by0, cy), V::sub(cy, by1)), zero);
+    F fx = V::max(V::sub(cx, bx0), V::sub(bx1, cx));
+    F fy = V::max(V::sub(cy, by0), V::sub(by1, cy));
+    F r2 = V::mul(r, r);
+    F near2 = V::add(V::mul(nx, nx), V::mul(ny, ny));
+    F far2 = V::add(V::mul(fx, fx), V::mul(fy, fy));
+    M touch = V::and_(V::le(near2, r2), V::ge(far2, r2));
+
+    store<V>(out + i, inside, touch);
+}
+
+template <typename V>
+void segmentsLassoBlock(const SegmentSpan& s, size_t i, const LassoEdges& e, Containment* out) {
+    using F = typename V::F;
+    using M = typename V::M;
+    F x1 = V::load(s.x1 + i), y1 = V::load(s.y1 + i);
+    F x2 = V::load(s.x2 + i), y2 = V::load(s.y2 + i);
+
+    // Most of a large board is nowhere near the lasso
+    M nearby = boxesOverlap<V>(V::min(x1, x2), V::min(y1, y2), V::max(x1, x2), V::max(y1, y2), e.bounds);
+    if (!V::bits(nearby)) {
+        store<V>(out + i, V::none(), V::none());
+        return;
+    }
+
+    F dx = V::sub(x2, x1), dy = V::sub(y2, y1);
+    F zero = V::set(0.0f);
+    M in1 = V::none(), in2 = V::none(), cross = V::none();
+    for (size_t k = 0; k < e.count; k++) {
+        F ax = V::set(e.ax[k]), ay = V::set(e.ay[k]);
+        F bx = V::set(e.bx[k]), by = V::set(e.by[k]);
+        F slope = V::set(e.slope[k]);
+
+        // Crossing number of each endpoint: a ray towards +x crosses this edge
+        M span1 = V::xor_(V::gt(ay, y1), V::gt(by, y1));
+        M span2 = V::xor_(V::gt(ay, y2), V::gt(by, y2));
+        in1 = V::xor_(in1, V::and_(span1, V::lt(x1, V::add(ax, V::mul(V::sub(y1, ay), slope)))));
+        in2 = V::xor_(in2, V::and_(span2, V::lt(x2, V::add(ax, V::mul(V::sub(y2, ay), slope)))));
+
+        // Proper intersection of the segment with the edge
+        F ex = V::sub(bx, ax), ey = V::sub(by, ay);
+        F d1 = V::sub(V::mul(ex, V::sub(y1, ay)), V::mul(ey, V::sub(x1, ax)));
+        F d2 = V::sub(V::mul(ex, V::sub(y2, ay)), V::mul(ey, V::sub(x2, ax)));
+        F d3 = V::sub(V::mul(dx, V::sub(ay, y1)), V::mul(dy, V::sub(ax, x1)));
+        F d4 = V::sub(V::mul(dx, V::sub(by, y1)), V::mul(dy, V::sub(bx, x1)));
+        cross = V::or_(cross, V::and_(V::lt(V::mul(d1, d2), zero), V::lt(V::mul(d3, d4), zero)));
+    }
+
+    M inside = V::andNot(V::and_(in1, in2), cross);
+    M touch = V::or_(V::or_(in1, in2), cross);
+    store<V>(out + i, V::and_(inside, nearby), V::and_(touch, nearby));
+}
+
+template <typename V>
+void circlesLassoBlock(const CircleSpan& c, size_t i, const LassoEdges& e, Containment* out) {
+    using F = typename V::F;
+    using M = typename V::M;
+    F cx = V::load(c.cx + i), cy = V::load(c.cy + i), r = V::load(c.r + i);
+
+    M nearby = boxesOverlap<V>(V::sub(cx, r), V::sub(cy, r), V::add(cx, r), V::add(cy, r), e.bounds);
+    if (!V::bits(nearby)) {
+        store<V>(out + i, V::none(), V::none());
+        return;
+    }
+
+    F r2 = V::mul(r, r);
+    F zero = V::set(0.0f), one = V::set(1.0f);
+    F minD2 = V::set(FLT_MAX);
+    M inCenter = V::none(), crossing = V::none();
+    for (size_t k = 0; k < e.count; k++) {
+        F ax = V::set(e.ax[k]), ay = V::set(e.ay[k]);
+        F bx = V::set(e.bx[k]), by = V::set(e.by[k]);
+
+        M span = V::xor_(V::gt(ay, cy), V::gt(by, cy));
+        inCenter = V::xor_(inCenter, V::and_(span, V::lt(cx, V::add(ax, V::mul(V::sub(cy, ay), V::set(e.slope[k]))))));
+
+        // Nearest and farthest points of the edge from the center; the
+        // outline crosses the edge when the radius lies between them
+        F ex = V::sub(bx, ax), ey = V::sub(by, ay);
+        F rx = V::sub(cx, ax), ry = V::sub(cy, ay);
+        F t = V::mul(V::add(V::mul(rx, ex), V::mul(ry, ey)), V::set(e.invLen2[k]));
+        t = V::min(V::max(t, zero), one);
+        F qx = V::sub(rx, V::mul(t, ex)), qy = V::sub(ry, V::mul(t, ey));
+        F d2 = V::add(V::mul(qx, qx), V::mul(qy, qy));
+        F sx = V::sub(cx, bx), sy = V::sub(cy, by);
+        F far2 = V::max(V::add(V::mul(rx, rx), V::mul(ry, ry)), V::add(V::mul(sx, sx), V::mul(sy, sy)));
+        crossing = V::or_(crossing, V::and_(V::le(d2, r2), V::ge(far2, r2)));
+        minD2 = V::min(minD2, d2);
+    }
+
+    // Inside only if the whole disc is: the center is enclosed and no edge comes closer than r
+    M inside = V::andNot(V::and_(inCenter, V::ge(minD2, r2)), crossing);
+    M touch = V::or_(crossing, inside);
+    store<V>(out + i, V::and_(inside, nearby), V::and_(touch, nearby));
+}
+
+template <typename V>
+void segmentsBox(const SegmentSpan& s, size_t begin, size_t end, const Bounds& box, Containment* out) {
+    forEachBlock<V>(begin, end, [&](auto ops, size_t i) { segmentsBoxBlock<decltype(ops)>(s, i, box, out); });
+}
+
+template <typename V>
+void circlesBox(const CircleSpan& c, size_t begin, size_t end, const Bounds& box, Containment* out) {
+    forEachBlock<V>(begin, end, [&](auto ops, size_t i) { circlesBoxBlock<decltype(ops)>(c, i, box, out); });
+}
+
+template <typename V>
+void segmentsLasso(const SegmentSpan& s, size_t begin, size_t end, const LassoEdges& e, Containment* out) {
+    forEachBlock<V>(begin, end, [&](auto ops, size_t i) { segmentsLassoBlock<decltype(ops)>(s, i, e, out); });
+}
+
+template <typename V>
+void circlesLasso(const CircleSpan& c, size_t begin, size_t end, const LassoEdges& e, Containment* out) {
+    forEachBlock<V>(begin, end, [&](auto ops, size_t i) { circlesLassoBlock<decltype(ops)>(c, i, e, out); });
+}
+
+// In place; x and y of a lane are both read before either is written
+template <typename V>
+void transformPoints(float* xs, float* ys, size_t begin, size_t end, const Affine& m) {
+    forEachBlock<V>(begin, end, [&](auto ops, size_t i) {
+        using W = decltype(ops);
+        auto x = W::load(xs + i), y = W::load(ys + i);
+        W::store(xs + i, W::add(W::add(W::mul(W::set(m.a), x), W::mul(W::set(m.b), y)), W::set(m.tx)));
+        W::store(ys + i, W::add(W::add(W::mul(W::set(m.c), x), W::mul(W::set(m.d), y)), W::set(m.ty)));
+    });
+}
+
+template <typename V>
+constexpr SelectionKernel::detail::Kernels makeKernels() {
+    return { &segmentsBox<V>, &circlesBox<V>, &segmentsLasso<V>, &circlesLasso<V>, &transformPoints<V> };
+}
+
+}
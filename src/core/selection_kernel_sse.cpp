@@ -0,0 +1,47 @@
+// selection_kernel_sse.cpp
+
+#include "core/selection_kernel_impl.h"
+
+#ifdef SELECTION_KERNEL_X86
+
+#include <emmintrin.h>
+
+namespace {
+
+// SSE2 is part of x86-64, so this file needs no special compiler flags
+struct SseOps {
+    using F = __m128;
+    using M = __m128;
+    static constexpr size_t WIDTH = 4;
+
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F v) { _mm_storeu_ps(p, v); }
+    static F set(float v) { return _mm_set1_ps(v); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static M le(F a, F b) { return _mm_cmple_ps(a, b); }
+    static M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static M ge(F a, F b) { return _mm_cmpge_ps(a, b); }
+    static M none() { return _mm_setzero_ps(); }
+    static M and_(M a, M b) { return _mm_and_ps(a, b); }
+    static M or_(M a, M b) { return _mm_or_ps(a, b); }
+    static M xor_(M a, M b) { return _mm_xor_ps(a, b); }
+    static M andNot(M a, M b) { return _mm_andnot_ps(b, a); }
+    static unsigned bits(M m) { return (unsigned)_mm_movemask_ps(m); }
+};
+
+constexpr SelectionKernel::detail::Kernels sseTable = makeKernels<SseOps>();
+
+}
+
+const SelectionKernel::detail::Kernels* const SelectionKernel::detail::sseKernels = &sseTable;
+
+#else
+
+const SelectionKernel::detail::Kernels* const SelectionKernel::detail::sseKernels = nullptr;
+
+#endif
@@ -0,0 +1,44 @@
+// snap_engine.cpp
+
+#include "snap_engine.h"
+
+#include <cmath>
+
+void SnapEngine::SetGrid(float spacing, float originX, float originY) {
+    gridSpacing = spacing > 0.0f ? spacing : 0.0f;
+    gridOriginX = originX;
+    gridOriginY = originY;
+}
+
+bool SnapEngine::Snap(const CADDocument& doc, float x, float y, float tolerance, SnapResult& out,
+                      bool skipSelection) const {
+    SnapPoint point;
+    uint32_t layerId;
+    uint32_t objects = enabled & ~SnapBit(SnapKind::Grid);
+    if (objects && doc.NearestSnapPoint(x, y, tolerance, objects, point, layerId, skipSelection)) {
+        out.x = point.x;
+        out.y = point.y;
+        out.kind = point.snap;
+        out.entity = { layerId, point.kind, point.index };
+        return true;
+    }
+
+    if ((enabled & SnapBit(SnapKind::Grid)) && gridSpacing > 0.0f) {
+        out.x = gridOriginX + std::round((x - gridOriginX) / gridSpacing) * gridSpacing;
+        out.y = gridOriginY + std::round((y - gridOriginY) / gridSpacing) * gridSpacing;
+        out.kind = SnapKind::Grid;
+        out.entity = EntityRef{};
+        return true;
+    }
+    return false;
+}
+
+const char* SnapEngine::KindName(SnapKind kind) {
+    switch (kind) {
+    case SnapKind::Endpoint: return "Endpoint";
+    case SnapKind::Midpoint: return "Midpoint";
+    case SnapKind::Center: return "Center";
+    case SnapKind::Grid: return "Grid";
+    }
+    return "";
+}
@@ -0,0 +1,40 @@
+// snap_engine.h
+
+#pragma once
+
+#include <cstdint>
+
+#include "core/cad_document.h"
+#include "core/snap_index.h"
+
+struct SnapResult {
+    float x = 0.0f, y = 0.0f;
+    SnapKind kind = SnapKind::Grid;
+    EntityRef entity;           // Meaningless for grid snaps
+};
+
+// Decides where the cursor snaps to. Object candidates (endpoints,
+// midpoints, centers) come from the per-layer snap indexes, which the
+// document keeps up to date; the grid is computed, not stored. An object
+// candidate within the tolerance always beats the grid.
+class SnapEngine {
+public:
+    // Spacing 0 turns grid snapping off
+    void SetGrid(float spacing, float originX = 0.0f, float originY = 0.0f);
+    float GetGridSpacing() const { return gridSpacing; }
+    // SnapBit() of every enabled kind
+    void SetEnabled(uint32_t mask) { enabled = mask; }
+    uint32_t GetEnabled() const { return enabled; }
+
+    // False when nothing is enabled that applies; `out` is then untouched.
+    // skipSelection leaves the selected entities out of the object candidates.
+    bool Snap(const CADDocument& doc, float x, float y, float tolerance, SnapResult& out,
+              bool skipSelection = false) const;
+
+    static const char* KindName(SnapKind kind);
+
+private:
+    float gridSpacing = 0.0f;
+    float gridOriginX = 0.0f, gridOriginY = 0.0f;
+    uint32_t enabled = SNAP_ALL;
+};
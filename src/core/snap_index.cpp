@@ -0,0 +1,171 @@
+// snap_index.cpp
+
+#include "snap_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+int32_t SnapIndex::cellCoord(float v) const {
+    float c = std::floor(v * invCellSize);
+    return (int32_t)std::clamp(c, (float)INT32_MIN / 2, (float)INT32_MAX / 2);
+}
+
+SnapIndex::Cell& SnapIndex::cellAt(int32_t x, int32_t y) {
+    if (inGrid(x, y)) return grid[(size_t)(y - gridY) * gridW + (x - gridX)];
+    return cells[cellKey(x, y)];
+}
+
+const SnapIndex::Cell* SnapIndex::findCell(int32_t x, int32_t y) const {
+    if (inGrid(x, y)) return &grid[(size_t)(y - gridY) * gridW + (x - gridX)];
+    auto it = cells.find(cellKey(x, y));
+    return it != cells.end() ? &it->second : nullptr;
+}
+
+void SnapIndex::Clear() {
+    grid.clear();
+    cells.clear();
+    pool.Clear();
+    gridX = gridY = 0;
+    gridW = gridH = 0;
+    count = 0;
+}
+
+void SnapIndex::BulkLoad(const std::vector<SnapPoint>& points) {
+    Clear();
+    if (points.empty()) return;
+
+    float minX = points[0].x, minY = points[0].y, maxX = minX, maxY = minY;
+    for (const SnapPoint& p : points) {
+        minX = std::min(minX, p.x); maxX = std::max(maxX, p.x);
+        minY = std::min(minY, p.y); maxY = std::max(maxY, p.y);
+    }
+
+    // About two points per cell if they were spread evenly
+    float area = std::max(maxX - minX, 1e-3f) * std::max(maxY - minY, 1e-3f);
+    float size = std::sqrt(area / std::max<size_t>(points.size() / 2, 1));
+    cellSize = size > 1e-6f ? size : 1.0f;
+    invCellSize = 1.0f / cellSize;
+
+    gridX = cellCoord(minX);
+    gridY = cellCoord(minY);
+    gridW = (uint32_t)(cellCoord(maxX) - gridX + 1);
+    gridH = (uint32_t)(cellCoord(maxY) - gridY + 1);
+
+    // Count first, so every cell gets exactly its room in a single pool
+    std::vector<uint32_t> fill((size_t)gridW * gridH, 0);
+    for (const SnapPoint& p : points)
+        fill[(size_t)(cellCoord(p.y) - gridY) * gridW + (cellCoord(p.x) - gridX)]++;
+    grid.resize(fill.size());
+    pool.ReserveTotal(points.size());
+    for (size_t i = 0; i < fill.size(); i++)
+        if (fill[i]) pool.Reserve(grid[i], fill[i]);
+
+    for (const SnapPoint& p : points) Insert(p);
+}
+
+void SnapIndex::Insert(const SnapPoint& point) {
+    pool.Push(cellAt(cellCoord(point.x), cellCoord(point.y)), point);
+    count++;
+    if (pool.NeedsCompaction()) compact();
+}
+
+void SnapIndex::compact() {
+    pool.Compact([&](auto&& visit) {
+        for (Cell& cell : grid) visit(cell);
+        for (auto& [key, cell] : cells) visit(cell);
+    });
+}
+
+bool SnapIndex::Remove(const SnapPoint& point) {
+    int32_t x = cellCoord(point.x), y = cellCoord(point.y);
+    Cell* cell = const_cast<Cell*>(findCell(x, y));
+    if (!cell) return false;
+
+    for (uint32_t i = 0; i < cell->size; i++) {
+        const SnapPoint& p = pool.At(*cell, i);
+        if (p.index == point.index && p.kind == point.kind && p.snap == point.snap && p.x == point.x && p.y == point.y) {
+            pool.At(*cell, i) = pool.Back(*cell);
+            pool.PopBack(*cell);
+            if (cell->size == 0 && !inGrid(x, y)) {
+                pool.Release(*cell);
+                cells.erase(cellKey(x, y));
+            }
+            count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SnapIndex::Nearest(float x, float y, float radius, uint32_t snapMask, SnapPoint& out, float& distance,
+                        const std::vector<uint64_t>* skip) const {
+    float best = radius * radius;
+    bool found = false;
+    auto scan = [&](const Cell& cell) {
+        for (const SnapPoint& p : pool.Items(cell)) {
+            float dx = p.x - x, dy = p.y - y;
+            float d2 = dx * dx + dy * dy;
+            if (d2 <= best && (snapMask & SnapBit(p.snap)) &&
+                !(skip && std::binary_search(skip->begin(), skip->end(), SkipKey(p.kind, p.index)))) {
+                best = d2;
+                out = p;
+                found = true;
+            }
+        }
+    };
+
+    int32_t x0 = cellCoord(x - radius), x1 = cellCoord(x + radius);
+    int32_t y0 = cellCoord(y - radius), y1 = cellCoord(y + radius);
+
+    // Sparse cells: probe them one by one during the ring walk, or scan the
+    // map up front when it is shorter than the range
+    uint64_t span = (uint64_t)((int64_t)x1 - x0 + 1) * (uint64_t)((int64_t)y1 - y0 + 1);
+    bool probeSparse = !cells.empty() && span <= cells.size();
+    if (!cells.empty() && !probeSparse) {
+        for (const auto& [key, cell] : cells) {
+            int32_t cx = (int32_t)(uint32_t)(key >> 32), cy = (int32_t)(uint32_t)key;
+            if (cx >= x0 && cx <= x1 && cy >= y0 && cy <= y1) scan(cell);
+        }
+    }
+
+    // Cells the ring walk has to visit
+    int32_t lx0 = x0, lx1 = x1, ly0 = y0, ly1 = y1;
+    if (!probeSparse) {
+        lx0 = std::max(lx0, gridX); lx1 = std::min(lx1, gridX + (int32_t)gridW - 1);
+        ly0 = std::max(ly0, gridY); ly1 = std::min(ly1, gridY + (int32_t)gridH - 1);
+    }
+    auto visit = [&](int32_t cx, int32_t cy) {
+        if (inGrid(cx, cy)) {
+            scan(grid[(size_t)(cy - gridY) * gridW + (cx - gridX)]);
+        } else if (probeSparse) {
+            auto it = cells.find(cellKey(cx, cy));
+            if (it != cells.end()) scan(it->second);
+        }
+    };
+
+    // Rings of cells around the query, nearest first. Everything in ring r
+    // is at least (r - 1) cells away, so once the best hit is closer than
+    // that the remaining rings cannot improve it.
+    if (lx0 <= lx1 && ly0 <= ly1) {
+        int32_t ccx = cellCoord(x), ccy = cellCoord(y);
+        int32_t rings = std::max(std::max(ccx - x0, x1 - ccx), std::max(ccy - y0, y1 - ccy));
+        for (int32_t r = 0; r <= rings; r++) {
+            float reach = (float)(r - 1) * cellSize;
+            if (found && r > 0 && best <= reach * reach) break;
+
+            int32_t ry0 = std::max(ccy - r, ly0), ry1 = std::min(ccy + r, ly1);
+            for (int32_t cy = ry0; cy <= ry1; cy++) {
+                if (cy == ccy - r || cy == ccy + r) {
+                    for (int32_t cx = std::max(ccx - r, lx0); cx <= std::min(ccx + r, lx1); cx++) visit(cx, cy);
+                } else {
+                    if (ccx - r >= lx0 && ccx - r <= lx1) visit(ccx - r, cy);
+                    if (r > 0 && ccx + r >= lx0 && ccx + r <= lx1) visit(ccx + r, cy);
+                }
+            }
+        }
+    }
+
+    if (found) distance = std::sqrt(best);
+    return found;
+}
@@ -0,0 +1,69 @@
+// snap_index.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "core/entity/entity.h"
+#include "core/list_pool.h"
+
+// What a snap candidate is on its entity
+enum class SnapKind : uint8_t { Endpoint, Midpoint, Center, Grid };
+
+inline uint32_t SnapBit(SnapKind kind) { return 1u << (uint32_t)kind; }
+constexpr uint32_t SNAP_ALL = 0xffffffffu;
+
+struct SnapPoint {
+    float x, y;
+    uint32_t index;     // Into the layer's array of that entity kind
+    EntityKind kind;
+    SnapKind snap;
+};
+
+// Uniform grid over the snap candidates of one layer. Cells inside the
+// extent seen at bulk load form a dense array; points added elsewhere later
+// go to a sparse map. Nothing refers back into the cells, so a point is 16
+// bytes and Insert/Remove cost O(points in its cell). The cells' points all
+// live in one pool rather than one allocation per cell.
+class SnapIndex {
+public:
+    // Replaces the contents; the cell size is derived from the point density
+    void BulkLoad(const std::vector<SnapPoint>& points);
+    void Clear();
+
+    void Insert(const SnapPoint& point);
+    // Matched on entity, kind and exact position, so pass the coordinates it was inserted with
+    bool Remove(const SnapPoint& point);
+
+    // Closest point of an enabled kind within `radius` of (x, y), passing
+    // over the entities whose SkipKey is in the sorted `skip`
+    bool Nearest(float x, float y, float radius, uint32_t snapMask, SnapPoint& out, float& distance,
+                 const std::vector<uint64_t>* skip = nullptr) const;
+    static uint64_t SkipKey(EntityKind kind, uint32_t index) { return ((uint64_t)kind << 32) | index; }
+
+    size_t Size() const { return count; }
+
+private:
+    using Cell = ListPool<SnapPoint>::List;
+
+    int32_t cellCoord(float v) const;
+    static uint64_t cellKey(int32_t x, int32_t y) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y; }
+    bool inGrid(int32_t x, int32_t y) const {
+        return x >= gridX && y >= gridY && (uint32_t)(x - gridX) < gridW && (uint32_t)(y - gridY) < gridH;
+    }
+    Cell& cellAt(int32_t x, int32_t y);
+    const Cell* findCell(int32_t x, int32_t y) const;
+    void compact();
+
+    float cellSize = 1.0f;
+    float invCellSize = 1.0f;
+    int32_t gridX = 0, gridY = 0;
+    uint32_t gridW = 0, gridH = 0;
+    std::vector<Cell> grid;
+    std::unordered_map<uint64_t, Cell> cells;
+    ListPool<SnapPoint> pool;
+    size_t count = 0;
+};
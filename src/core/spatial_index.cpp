@@ -0,0 +1,347 @@
+// spatial_index.cpp
+
+#include "core/spatial_index.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+    float distanceToBox(float x, float y, const Bounds& b) {
+        float dx = std::max(std::max(b.minX - x, x - b.maxX), 0.0f);
+        float dy = std::max(std::max(b.minY - y, y - b.maxY), 0.0f);
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    bool overlaps(const Bounds& a, const Bounds& b) {
+        return a.maxX >= b.minX && a.minX <= b.maxX && a.maxY >= b.minY && a.minY <= b.maxY;
+    }
+}
+
+void SpatialIndex::setBaseCell(float size) {
+    baseCell = size;
+    float cell = size;
+    for (Level& level : levels) {
+        level.cellSize = cell;
+        level.invCellSize = 1.0f / cell;
+        cell *= 2.0f;
+    }
+}
+
+int SpatialIndex::levelFor(const Bounds& b) const {
+    float size = std::max(b.maxX - b.minX, b.maxY - b.minY);
+    if (!(size > baseCell)) return 0;
+    int exponent;
+    std::frexp(size / baseCell, &exponent);  // size / baseCell in [2^(e-1), 2^e)
+    return std::min(exponent, MAX_LEVELS - 1);
+}
+
+int32_t SpatialIndex::cellCoord(float v, const Level& level) const {
+    float c = std::floor(v * level.invCellSize);
+    return (int32_t)std::clamp(c, (float)INT32_MIN / 2, (float)INT32_MAX / 2);
+}
+
+uint64_t SpatialIndex::cellKey(int32_t x, int32_t y) {
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+uint32_t& SpatialIndex::slotOf(EntityKind kind, uint32_t index) {
+    std::vector<uint32_t>& map = itemOf[(size_t)kind];
+    if (index >= map.size()) map.resize(index + 1, NO_ITEM);
+    return map[index];
+}
+
+SpatialIndex::Cell& SpatialIndex::cellAt(Level& level, uint64_t key) {
+    int32_t x = keyX(key), y = keyY(key);
+    if (level.InGrid(x, y))
+        return level.grid[(size_t)(y - level.gridY) * level.gridW + (x - level.gridX)];
+    return level.cells[key];
+}
+
+void SpatialIndex::releaseCell(Level& level, uint64_t key) {
+    // Grid cells keep their room; sparse ones go away when empty
+    if (level.InGrid(keyX(key), keyY(key))) return;
+    auto found = level.cells.find(key);
+    pool.Release(found->second);
+    level.cells.erase(found);
+}
+
+void SpatialIndex::compact() {
+    pool.Compact([&](auto&& visit) {
+        for (Level& level : levels) {
+            for (Cell& cell : level.grid) visit(cell);
+            for (auto& [key, cell] : level.cells) visit(cell);
+        }
+    });
+}
+
+void SpatialIndex::Clear() {
+    items.clear();
+    for (auto& map : itemOf) map.clear();
+    for (Level& level : levels) {
+        level.cells.clear();
+        level.grid.clear();
+        level.gridW = level.gridH = 0;
+        level.count = 0;
+    }
+    pool.Clear();
+    extent = { 0.0f, 0.0f, 0.0f, 0.0f };
+}
+
+void SpatialIndex::BulkLoad(const std::vector<Entry>& entries) {
+    Clear();
+
+    // Median entity size as the base cell keeps most entities on level 0
+    // with a handful per cell
+    std::vector<float> sizes;
+    sizes.reserve(entries.size());
+    for (const Entry& e : entries)
+        sizes.push_back(std::max(e.bounds.maxX - e.bounds.minX, e.bounds.maxY - e.bounds.minY));
+    float median = 1.0f;
+    if (!sizes.empty()) {
+        auto mid = sizes.begin() + sizes.size() / 2;
+        std::nth_element(sizes.begin(), mid, sizes.end());
+        median = *mid;
+    }
+    setBaseCell(median > 1e-6f ? median : 1.0f);
+
+    // Dense grids over the loaded extent, for levels that hold enough
+    // entities to be worth it (at most a few cells per entity)
+    size_t perLevel[MAX_LEVELS] = {};
+    Bounds all{ FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (const Entry& e : entries) {
+        perLevel[levelFor(e.bounds)]++;
+        all.minX = std::min(all.minX, e.bounds.minX);
+        all.minY = std::min(all.minY, e.bounds.minY);
+        all.maxX = std::max(all.maxX, e.bounds.maxX);
+        all.maxY = std::max(all.maxY, e.bounds.maxY);
+    }
+    for (int l = 0; l < MAX_LEVELS && !entries.empty(); ++l) {
+        Level& level = levels[l];
+        int32_t x0 = cellCoord(all.minX, level), x1 = cellCoord(all.maxX, level);
+        int32_t y0 = cellCoord(all.minY, level), y1 = cellCoord(all.maxY, level);
+        uint64_t cells = (uint64_t)((int64_t)x1 - x0 + 1) * (uint64_t)((int64_t)y1 - y0 + 1);
+        if (perLevel[l] == 0 || cells > 4 * perLevel[l]) continue;
+
+        level.gridX = x0;
+        level.gridY = y0;
+        level.gridW = (uint32_t)(x1 - x0 + 1);
+        level.gridH = (uint32_t)(y1 - y0 + 1);
+        level.grid.resize((size_t)cells);
+    }
+
+    // Insert cell by cell with exact reservations, so the pool is one
+    // allocation and neighbouring cells sit close together in it
+    struct Placement {
+        int32_t level, y, x;
+        uint32_t entry;
+        bool SameCell(const Placement& o) const { return level == o.level && y == o.y && x == o.x; }
+    };
+    std::vector<Placement> order(entries.size());
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        int l = levelFor(entries[i].bounds);
+        const Level& level = levels[l];
+        order[i] = { l, cellCoord(entries[i].bounds.minY, level), cellCoord(entries[i].bounds.minX, level), i };
+    }
+    std::sort(order.begin(), order.end(), [](const Placement& a, const Placement& b) {
+        if (a.level != b.level) return a.level < b.level;
+        if (a.y != b.y) return a.y < b.y;
+        return a.x < b.x;
+    });
+
+    items.reserve(entries.size());
+    pool.ReserveTotal(entries.size());
+    for (size_t first = 0; first < order.size();) {
+        size_t last = first + 1;
+        while (last < order.size() && order[last].SameCell(order[first])) ++last;
+
+        const Placement& head = order[first];
+        pool.Reserve(cellAt(levels[head.level], cellKey(head.x, head.y)), (uint32_t)(last - first));
+        for (size_t i = first; i < last; ++i) {
+            const Entry& e = entries[order[i].entry];
+            Insert(e.kind, e.index, e.bounds);
+        }
+        first = last;
+    }
+}
+
+void SpatialIndex::link(uint32_t i) {
+    Item& item = items[i];
+    item.level = (uint8_t)levelFor(item.bounds);
+    Level& level = levels[item.level];
+    item.cell = cellKey(cellCoord(item.bounds.minX, level), cellCoord(item.bounds.minY, level));
+
+    Cell& cell = cellAt(level, item.cell);
+    item.cellSlot = cell.size;
+    pool.Push(cell, { item.bounds, item.index, item.kind });
+    level.count++;
+    if (pool.NeedsCompaction()) compact();
+}
+
+void SpatialIndex::unlink(uint32_t i) {
+    Item& item = items[i];
+    Level& level = levels[item.level];
+    Cell& cell = cellAt(level, item.cell);
+
+    // Swap-remove from the cell, fixing the slot of the entry that moved
+    const CellEntry& moved = pool.Back(cell);
+    items[itemOf[(size_t)moved.kind][moved.index]].cellSlot = item.cellSlot;
+    pool.At(cell, item.cellSlot) = moved;
+    pool.PopBack(cell);
+    if (cell.size == 0) releaseCell(level, item.cell);
+    level.count--;
+}
+
+void SpatialIndex::Insert(EntityKind kind, uint32_t index, const Bounds& bounds) {
+    uint32_t& slot = slotOf(kind, index);
+    if (slot != NO_ITEM) {
+        Update(kind, index, bounds);
+        return;
+    }
+
+    if (items.empty()) {
+        extent = bounds;
+    } else {
+        extent.minX = std::min(extent.minX, bounds.minX);
+        extent.minY = std::min(extent.minY, bounds.minY);
+        extent.maxX = std::max(extent.maxX, bounds.maxX);
+        extent.maxY = std::max(extent.maxY, bounds.maxY);
+    }
+
+    slot = (uint32_t)items.size();
+    items.push_back({ bounds, 0, 0, index, kind, 0 });
+    link(slot);
+}
+
+void SpatialIndex::Remove(EntityKind kind, uint32_t index) {
+    std::vector<uint32_t>& map = itemOf[(size_t)kind];
+    if (index >= map.size() || map[index] == NO_ITEM) return;
+
+    uint32_t i = map[index];
+    unlink(i);
+    map[index] = NO_ITEM;
+
+    // Keep items dense: move the last one into the hole (cells refer to
+    // entities, not items, so they need no fix-up)
+    uint32_t last = (uint32_t)items.size() - 1;
+    if (i != last) {
+        items[i] = items[last];
+        itemOf[(size_t)items[i].kind][items[i].index] = i;
+    }
+    items.pop_back();
+}
+
+void SpatialIndex::Update(EntityKind kind, uint32_t index, const Bounds& bounds) {
+    std::vector<uint32_t>& map = itemOf[(size_t)kind];
+    if (index >= map.size() || map[index] == NO_ITEM) {
+        Insert(kind, index, bounds);
+        return;
+    }
+
+    uint32_t i = map[index];
+    Item& item = items[i];
+    extent.minX = std::min(extent.minX, bounds.minX);
+    extent.minY = std::min(extent.minY, bounds.minY);
+    extent.maxX = std::max(extent.maxX, bounds.maxX);
+    extent.maxY = std::max(extent.maxY, bounds.maxY);
+
+    // Small moves usually stay in the same cell
+    int level = levelFor(bounds);
+    const Level& l = levels[level];
+    uint64_t cell = cellKey(cellCoord(bounds.minX, l), cellCoord(bounds.minY, l));
+    if (level == item.level && cell == item.cell) {
+        item.bounds = bounds;
+        pool.At(cellAt(levels[level], cell), item.cellSlot).bounds = bounds;
+        return;
+    }
+    unlink(i);
+    items[i].bounds = bounds;
+    link(i);
+}
+
+bool SpatialIndex::Contains(EntityKind kind, uint32_t index) const {
+    const std::vector<uint32_t>& map = itemOf[(size_t)kind];
+    return index < map.size() && map[index] != NO_ITEM;
+}
+
+template <typename Fn>
+void SpatialIndex::forEachCandidate(const Bounds& box, Fn&& fn) const {
+    for (const Level& level : levels) {
+        if (level.count == 0) continue;
+
+        // Entities overhang their cell by up to one cell towards +x/+y
+        int32_t x0 = cellCoord(box.minX, level) - 1, x1 = cellCoord(box.maxX, level);
+        int32_t y0 = cellCoord(box.minY, level) - 1, y1 = cellCoord(box.maxY, level);
+        auto visit = [&](const Cell& cell) {
+            for (const CellEntry& entry : pool.Items(cell))
+                if (overlaps(entry.bounds, box)) fn(entry);
+        };
+
+        // Dense part: clip the query to the grid and walk it row by row
+        if (!level.grid.empty()) {
+            int32_t gx0 = std::max(x0, level.gridX), gx1 = std::min(x1, level.gridX + (int32_t)level.gridW - 1);
+            int32_t gy0 = std::max(y0, level.gridY), gy1 = std::min(y1, level.gridY + (int32_t)level.gridH - 1);
+            for (int32_t y = gy0; y <= gy1; ++y) {
+                const Cell* row = &level.grid[(size_t)(y - level.gridY) * level.gridW];
+                for (int32_t x = gx0; x <= gx1; ++x)
+                    visit(row[x - level.gridX]);
+            }
+        }
+
+        // Sparse part: probe the cells outside the grid, or walk the map if that is shorter
+        if (level.cells.empty()) continue;
+        uint64_t span = (uint64_t)((int64_t)x1 - x0 + 1) * (uint64_t)((int64_t)y1 - y0 + 1);
+        if (span > level.cells.size()) {
+            for (const auto& entry : level.cells) {
+                int32_t cx = keyX(entry.first), cy = keyY(entry.first);
+                if (cx >= x0 && cx <= x1 && cy >= y0 && cy <= y1) visit(entry.second);
+            }
+        } else {
+            for (int32_t y = y0; y <= y1; ++y) {
+                for (int32_t x = x0; x <= x1; ++x) {
+                    if (level.InGrid(x, y)) continue;
+                    auto found = level.cells.find(cellKey(x, y));
+                    if (found != level.cells.end()) visit(found->second);
+                }
+            }
+        }
+    }
+}
+
+void SpatialIndex::QueryBox(const Bounds& box, std::vector<Hit>& out) const {
+    forEachCandidate(box, [&](const CellEntry& entry) {
+        out.push_back({ entry.kind, entry.index, 0.0f });
+    });
+}
+
+void SpatialIndex::QueryRadius(float x, float y, float radius, std::vector<Hit>& out) const {
+    Bounds box{ x - radius, y - radius, x + radius, y + radius };
+    forEachCandidate(box, [&](const CellEntry& entry) {
+        float d = distanceToBox(x, y, entry.bounds);
+        if (d <= radius) out.push_back({ entry.kind, entry.index, d });
+    });
+}
+
+void SpatialIndex::QueryNearest(float x, float y, size_t k, std::vector<Hit>& out) const {
+    if (k == 0 || items.empty()) return;
+
+    // Grow a search radius until it holds k entities; every entity closer
+    // than the radius has then been seen, so the k best are exact. Nothing
+    // lies beyond the farthest corner of the extent.
+    float farX = std::max(std::fabs(x - extent.minX), std::fabs(x - extent.maxX));
+    float farY = std::max(std::fabs(y - extent.minY), std::fabs(y - extent.maxY));
+    float limit = std::hypot(farX, farY);
+    float radius = std::max(baseCell, distanceToBox(x, y, extent));
+    std::vector<Hit> hits;
+    for (;;) {
+        hits.clear();
+        QueryRadius(x, y, radius, hits);
+        if (hits.size() >= k || radius >= limit) break;
+        radius *= 2.0f;
+    }
+
+    size_t count = std::min(k, hits.size());
+    std::partial_sort(hits.begin(), hits.begin() + count, hits.end(),
+        [](const Hit& a, const Hit& b) { return a.distance < b.distance; });
+    out.insert(out.end(), hits.begin(), hits.begin() + count);
+}
@@ -0,0 +1,126 @@
+// spatial_index.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "core/bounds.h"
+#include "core/entity/entity.h"
+#include "core/list_pool.h"
+
+// Loose hierarchical grid over the entity bounding boxes of one layer.
+// Level L has square cells of baseCell * 2^L. An entity lives in exactly
+// one cell: on the finest level whose cells are at least as large as the
+// entity, in the cell holding its min corner. It can therefore overhang
+// into the next cell on each axis, which queries account for by looking
+// one cell further on the min side.
+//
+// Insert, Remove and Update are O(1). Queries touch only the cells that
+// overlap the query on each occupied level, and results are by bounding
+// box: callers do exact geometric tests on the few candidates.
+class SpatialIndex {
+public:
+    SpatialIndex() { setBaseCell(1.0f); }
+
+    struct Entry {
+        EntityKind kind;
+        uint32_t index;     // Into the layer's array of that kind
+        Bounds bounds;
+    };
+
+    struct Hit {
+        EntityKind kind;
+        uint32_t index;
+        float distance;     // From the query point to the bounding box (0 inside)
+    };
+
+    // Replaces the contents. The cell size is derived from the entries, so
+    // loading a whole file this way is faster and better balanced than
+    // inserting one entity at a time.
+    void BulkLoad(const std::vector<Entry>& entries);
+    void Clear();
+
+    void Insert(EntityKind kind, uint32_t index, const Bounds& bounds);
+    void Remove(EntityKind kind, uint32_t index);
+    void Update(EntityKind kind, uint32_t index, const Bounds& bounds);
+    bool Contains(EntityKind kind, uint32_t index) const;
+
+    // Appends every entity whose box overlaps the query box
+    void QueryBox(const Bounds& box, std::vector<Hit>& out) const;
+    // Appends every entity whose box is within `radius` of (x, y)
+    void QueryRadius(float x, float y, float radius, std::vector<Hit>& out) const;
+    // Appends up to k entities closest to (x, y), nearest first
+    void QueryNearest(float x, float y, size_t k, std::vector<Hit>& out) const;
+
+    size_t Size() const { return items.size(); }
+
+private:
+    static constexpr uint32_t NO_ITEM = UINT32_MAX;
+    static constexpr int MAX_LEVELS = 24;
+    static constexpr size_t KIND_COUNT = 3;
+
+    struct Item {
+        Bounds bounds;
+        uint64_t cell;          // Key in levels[level]
+        uint32_t cellSlot;      // Position inside that cell's list
+        uint32_t index;
+        EntityKind kind;
+        uint8_t level;
+    };
+
+    // Everything a query needs is stored inline, so scanning a cell never
+    // leaves its own memory
+    struct CellEntry {
+        Bounds bounds;
+        uint32_t index;
+        EntityKind kind;
+    };
+
+    using Cell = ListPool<CellEntry>::List;
+
+    // Cells inside the extent seen at bulk load live in a dense grid, which
+    // is far cheaper to probe than a hash map; anything added outside it
+    // later goes to the sparse map. The entries of every cell on every
+    // level share one pool.
+    struct Level {
+        float cellSize = 0.0f;
+        float invCellSize = 0.0f;
+        size_t count = 0;
+        int32_t gridX = 0, gridY = 0;
+        uint32_t gridW = 0, gridH = 0;
+        std::vector<Cell> grid;
+        std::unordered_map<uint64_t, Cell> cells;
+
+        bool InGrid(int32_t x, int32_t y) const {
+            return x >= gridX && y >= gridY && (uint32_t)(x - gridX) < gridW && (uint32_t)(y - gridY) < gridH;
+        }
+    };
+
+    void setBaseCell(float size);
+    int levelFor(const Bounds& b) const;
+    int32_t cellCoord(float v, const Level& level) const;
+    static uint64_t cellKey(int32_t x, int32_t y);
+    static int32_t keyX(uint64_t key) { return (int32_t)(uint32_t)(key >> 32); }
+    static int32_t keyY(uint64_t key) { return (int32_t)(uint32_t)key; }
+    Cell& cellAt(Level& level, uint64_t key);
+    void releaseCell(Level& level, uint64_t key);
+    void compact();
+    uint32_t& slotOf(EntityKind kind, uint32_t index);
+
+    void link(uint32_t item);
+    void unlink(uint32_t item);
+
+    // Calls fn(const CellEntry&) for every entry whose box overlaps `box`
+    template <typename Fn>
+    void forEachCandidate(const Bounds& box, Fn&& fn) const;
+
+    float baseCell = 1.0f;
+    Bounds extent{ 0.0f, 0.0f, 0.0f, 0.0f };    // Grows with inserts; bounds kNN search
+    std::vector<Item> items;
+    std::vector<uint32_t> itemOf[KIND_COUNT];   // Per kind: entity index -> item, or NO_ITEM
+    Level levels[MAX_LEVELS];
+    ListPool<CellEntry> pool;
+};
@@ -1,14 +1,46 @@
 // header.cpp
 
 #include "header.h"
+#include "toolbar.h"
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_vulkan.h"
 #include <stdexcept>
+#include <cstdint>
+#include <cstddef>
 
 namespace GUI {
 
     static VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+    static ImGui_ImplVulkan_InitInfo vulkan_init_info = {};    // Kept for SetRenderPass
+    static uint64_t last_draw_hash = 0;
+    static Tool active_tool = Tool::None;
+    static EditCommand pending_command = EditCommand::None;
+    static std::vector<ImVec2> selection_outline;
+    static bool selection_crossing = false;
+    static CursorInfo cursor_info;
+
+    // Clicking the active tool again drops back to plain panning
+    static void ToolButton(const char* label, Tool tool) {
+        bool active = active_tool == tool;
+        if (active) ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetStyleColorVec4(ImGuiCol_ButtonActive));
+        if (ImGui::Button(label)) active_tool = active ? Tool::None : tool;
+        if (active) ImGui::PopStyleColor();
+    }
+
+    // Vertices are hashed as raw bytes, which is only deterministic while
+    // ImDrawVert has no padding (a custom IMGUI_OVERRIDE_DRAWVERT_STRUCT_LAYOUT could add some)
+    static_assert(sizeof(ImDrawVert) == sizeof(ImVec2) * 2 + sizeof(ImU32), "ImDrawVert is not the stock layout; hash its fields instead");
+
+    // FNV-1a over raw bytes; enough to tell whether ImGui produced a different frame
+    static uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
 
     void Init(GLFWwindow* window, VkInstance instance, VkDevice device, VkPhysicalDevice physical_device,
               uint32_t queue_family, VkQueue queue, VkRenderPass render_pass)
@@ -37,7 +69,8 @@ namespace GUI {
 
         ImGui_ImplGlfw_InitForVulkan(window, true);
 
-        ImGui_ImplVulkan_InitInfo init_info = {};
+        ImGui_ImplVulkan_InitInfo& init_info = vulkan_init_info;
+        init_info = {};
         init_info.Instance = instance;
         init_info.PhysicalDevice = physical_device;
         init_info.Device = device;
@@ -54,14 +87,29 @@ namespace GUI {
         ImGui_ImplVulkan_CreateFontsTexture();
     }
 
-    void RenderHeader() {
+    void SetRenderPass(VkRenderPass render_pass) {
+        // The backend bakes the render pass into its pipeline, so it is
+        // rebuilt; fonts go with it and are uploaded again
+        ImGui_ImplVulkan_Shutdown();
+        vulkan_init_info.RenderPass = render_pass;
+        ImGui_ImplVulkan_Init(&vulkan_init_info);
+        ImGui_ImplVulkan_CreateFontsTexture();
+    }
+
+    void RenderHeader(gui::Toolbar* menu_bar) {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
         ImGuiIO& io = ImGui::GetIO();
 
+        float top = 0.0f;
+        if (menu_bar) {
+            menu_bar->render();
+            top = ImGui::GetFrameHeight();
+        }
+
         // Header bar
-        ImGui::SetNextWindowPos(ImVec2(0, 0));
+        ImGui::SetNextWindowPos(ImVec2(0, top));
         ImGui::SetNextWindowSize(ImVec2(io.DisplaySize.x, 40));
         ImGui::SetNextWindowBgAlpha(1.0f);
 
@@ -74,21 +122,19 @@ namespace GUI {
 
         ImGui::Begin("Toolbar", nullptr, toolbar_flags);
 
-        if (ImGui::Button("Select")) {
-            // Handle select tool
-        }
+        ToolButton("Select", Tool::Select);
 
         ImGui::SameLine();
 
-        if (ImGui::Button("Move")) {
-            // Handle move tool
-        }
+        ToolButton("Move", Tool::Move);
 
         ImGui::SameLine();
 
-        if (ImGui::Button("Rotate")) {
-            // Handle rotate tool
-        }
+        if (ImGui::Button("Rotate")) pending_command = EditCommand::Rotate;
+        ImGui::SameLine();
+        if (ImGui::Button("Mirror H")) pending_command = EditCommand::MirrorHorizontal;
+        ImGui::SameLine();
+        if (ImGui::Button("Mirror V")) pending_command = EditCommand::MirrorVertical;
 
         ImGui::SameLine();
 
@@ -96,8 +142,25 @@ namespace GUI {
             // Handle zoom tool
         }
 
+        ImGui::SameLine();
+        ImGui::Text("X %.3f  Y %.3f  %s", cursor_info.worldX, cursor_info.worldY,
+                    cursor_info.snap ? cursor_info.snap : "");
+
         ImGui::End();
 
+        if (selection_outline.size() >= 2) {
+            ImU32 color = selection_crossing ? IM_COL32(80, 220, 120, 255) : IM_COL32(80, 160, 255, 255);
+            ImGui::GetForegroundDrawList()->AddPolyline(selection_outline.data(), (int)selection_outline.size(),
+                                                        color, ImDrawFlags_Closed, 1.0f);
+        }
+
+        if (cursor_info.snap) {
+            const float r = 4.0f;
+            ImVec2 c(cursor_info.markerX, cursor_info.markerY);
+            ImGui::GetForegroundDrawList()->AddRect(ImVec2(c.x - r, c.y - r), ImVec2(c.x + r, c.y + r),
+                                                    IM_COL32(255, 200, 40, 255));
+        }
+
         // Finalize ImGui frame
         ImGui::Render();
 
@@ -105,6 +168,56 @@ namespace GUI {
         // ImGui_ImplVulkan_RenderDrawData() will be called from Renderer
     }
 
+    Tool GetActiveTool() {
+        return active_tool;
+    }
+
+    EditCommand TakeEditCommand() {
+        EditCommand command = pending_command;
+        pending_command = EditCommand::None;
+        return command;
+    }
+
+    void SetSelectionOutline(const std::vector<float>& xs, const std::vector<float>& ys, bool crossing) {
+        selection_outline.clear();
+        for (size_t i = 0; i < xs.size() && i < ys.size(); i++) selection_outline.push_back(ImVec2(xs[i], ys[i]));
+        selection_crossing = crossing;
+    }
+
+    void SetCursorInfo(const CursorInfo& info) {
+        cursor_info = info;
+    }
+
+    bool NeedsRedraw() {
+        // Dragging a widget must keep frames coming even if the output is identical
+        bool active = ImGui::IsAnyItemActive();
+
+        uint64_t hash = 14695981039346656037ull;
+        ImDrawData* draw_data = ImGui::GetDrawData();
+        if (draw_data) {
+            hash = HashBytes(hash, &draw_data->DisplaySize, sizeof(draw_data->DisplaySize));
+            for (int n = 0; n < draw_data->CmdListsCount; n++) {
+                const ImDrawList* list = draw_data->CmdLists[n];
+                hash = HashBytes(hash, list->VtxBuffer.Data, list->VtxBuffer.Size * sizeof(ImDrawVert));
+                hash = HashBytes(hash, list->IdxBuffer.Data, list->IdxBuffer.Size * sizeof(ImDrawIdx));
+                // Commands field by field: the struct has padding, which
+                // nothing promises to zero
+                for (int c = 0; c < list->CmdBuffer.Size; c++) {
+                    const ImDrawCmd& cmd = list->CmdBuffer[c];
+                    hash = HashBytes(hash, &cmd.ClipRect, sizeof(cmd.ClipRect));
+                    hash = HashBytes(hash, &cmd.TextureId, sizeof(cmd.TextureId));
+                    hash = HashBytes(hash, &cmd.VtxOffset, sizeof(cmd.VtxOffset));
+                    hash = HashBytes(hash, &cmd.IdxOffset, sizeof(cmd.IdxOffset));
+                    hash = HashBytes(hash, &cmd.ElemCount, sizeof(cmd.ElemCount));
+                }
+            }
+        }
+
+        bool changed = hash != last_draw_hash;
+        last_draw_hash = hash;
+        return changed || active;
+    }
+
     void Cleanup() {
         ImGui_ImplVulkan_Shutdown();
         ImGui_ImplGlfw_Shutdown();
@@ -4,12 +4,44 @@
 
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
+#include <vector>
+
+namespace gui { class Toolbar; }
 
 namespace GUI {
+    // Tool picked in the header bar; decides what a left click in the viewport does
+    enum class Tool { None, Select, Move, Zoom };
+
+    // One-shot edits from header buttons; the caller applies them to the selection
+    enum class EditCommand { None, Rotate, MirrorHorizontal, MirrorVertical };
+
     void Init(GLFWwindow* window, VkInstance instance, VkDevice device, VkPhysicalDevice physical_device,
               uint32_t queue_family, VkQueue queue, VkRenderPass render_pass);
+    // Rebuilds the ImGui Vulkan backend against a new render pass; the
+    // device must be idle
+    void SetRenderPass(VkRenderPass render_pass);
+
+    // The menu bar, when given, is drawn above the header bar
+    void RenderHeader(gui::Toolbar* menu_bar = nullptr);
+    Tool GetActiveTool();
+    // Command clicked since the last call, or None
+    EditCommand TakeEditCommand();
+
+    // Outline of a selection drag in window coordinates, drawn over the
+    // scene; empty hides it. Crossing outlines are drawn in a second colour.
+    void SetSelectionOutline(const std::vector<float>& xs, const std::vector<float>& ys, bool crossing);
+
+    // Cursor position shown in the header bar, after snapping
+    struct CursorInfo {
+        float worldX = 0.0f, worldY = 0.0f;
+        const char* snap = nullptr;         // Name of the snap in effect, if any
+        float markerX = 0.0f, markerY = 0.0f;  // Snapped point in window coordinates
+    };
+    void SetCursorInfo(const CursorInfo& info);
 
-    void RenderHeader();
+    // True when the UI built by the last RenderHeader differs from the one
+    // last reported, or a widget is being interacted with
+    bool NeedsRedraw();
 
     void Cleanup();
 }
@@ -1,5 +1,6 @@
 #include "toolbar.h"
 #include "imgui.h"
+#include "core/cad_document.h"
 
 namespace gui {
 
@@ -14,8 +15,8 @@ void Toolbar::render() {
         }
 
         if (ImGui::BeginMenu("Edit")) {
-            if (ImGui::MenuItem("Undo")) { /* TODO: Add undo */ }
-            if (ImGui::MenuItem("Redo")) { /* TODO: Add redo */ }
+            if (ImGui::MenuItem("Undo", "Ctrl+Z", false, doc.CanUndo())) doc.Undo();
+            if (ImGui::MenuItem("Redo", "Ctrl+Y", false, doc.CanRedo())) doc.Redo();
             ImGui::EndMenu();
         }
 
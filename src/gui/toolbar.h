@@ -1,10 +1,17 @@
 #pragma once
 
+class CADDocument;
+
 namespace gui {
 
+// Main menu bar; drawn by GUI::RenderHeader above the header bar
 class Toolbar {
 public:
+    explicit Toolbar(CADDocument& doc) : doc(doc) {}
     void render();
+
+private:
+    CADDocument& doc;
 };
 
 } // namespace gui
@@ -4,16 +4,28 @@
 #include <vulkan/vulkan.h>
 #include <iostream>
 
+#include "imgui.h"
 #include "gui/header.h"
+#include "gui/toolbar.h"
 #include "rendering/renderer.h"
 #include "core/cad_document.h"
+#include "core/selection_kernel.h"
+#include "core/snap_engine.h"
 #include "core/entity/line_entity.h"
 #include "core/entity/circle_entity.h"
+#include "core/entity/track_entity.h"
 
 #include <memory>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
 
 // Global camera state
 glm::vec2 pan = glm::vec2(0.0f);
@@ -21,17 +33,254 @@ float zoom = 100.0f;
 bool dragging = false;
 double lastMouseX = 0.0, lastMouseY = 0.0;
 Renderer* g_renderer = nullptr;
+CADDocument* g_doc = nullptr;
+
+// How close, in screen pixels, the cursor must be to an entity's outline to pick it
+constexpr float PICK_TOLERANCE_PIXELS = 5.0f;
+constexpr float SNAP_TOLERANCE_PIXELS = 8.0f;
+bool hoverPending = false;  // Cursor or camera moved since the last hover pick and snap
+SnapEngine snapper;
+SnapResult cursorSnap;      // Where the cursor snaps to, updated once per frame
+bool cursorSnapped = false;
+
+// Select tool drag, in window coordinates: a rubber band, or a freehand lasso with Alt held
+struct SelectionDrag {
+    bool active = false;
+    bool lasso = false;
+    bool additive = false;
+    double startX = 0.0, startY = 0.0;
+    std::vector<float> xs, ys;  // Outline so far
+};
+SelectionDrag selectDrag;
+constexpr double CLICK_SLOP_PIXELS = 3.0;   // Less travel than this is a click, not a drag
+
+// Move tool drag: the selection follows the snapped cursor as a GPU-side
+// preview and the document is only edited on release
+struct MoveDrag {
+    bool active = false;
+    glm::vec2 base = glm::vec2(0.0f);   // Snapped world point that was grabbed
+};
+MoveDrag moveDrag;
+
+// Input received during one event pump; folded into a single camera update per frame
+struct InputAccumulator {
+    double dragX = 0.0, dragY = 0.0; // cursor travel in pixels while dragging
+    float zoomFactor = 1.0f;         // product of all scroll steps
+    bool changed = false;
+};
+InputAccumulator input;
+
+// Cursor positions are in window coordinates, which differ from
+// framebuffer pixels on high-DPI displays
+glm::vec2 window_to_world(GLFWwindow* window, double x, double y) {
+    int win_w, win_h, fb_w, fb_h;
+    glfwGetWindowSize(window, &win_w, &win_h);
+    glfwGetFramebufferSize(window, &fb_w, &fb_h);
+    if (win_w <= 0 || win_h <= 0) return glm::vec2(0.0f);
+    return g_renderer->ScreenToWorld((float)(x * fb_w / win_w), (float)(y * fb_h / win_h));
+}
+
+glm::vec2 world_to_window(GLFWwindow* window, float x, float y) {
+    int win_w, win_h, fb_w, fb_h;
+    glfwGetWindowSize(window, &win_w, &win_h);
+    glfwGetFramebufferSize(window, &fb_w, &fb_h);
+    if (fb_w <= 0 || fb_h <= 0) return glm::vec2(0.0f);
+    glm::vec2 p = g_renderer->WorldToScreen(x, y);
+    return glm::vec2(p.x * win_w / fb_w, p.y * win_h / fb_h);
+}
+
+// Closest entity under the cursor, if any is within the pick tolerance
+bool pick_at_cursor(GLFWwindow* window, EntityRef& hit) {
+    if (!g_renderer || !g_doc) return false;
+
+    double cx, cy;
+    glfwGetCursorPos(window, &cx, &cy);
+    glm::vec2 world = window_to_world(window, cx, cy);
+    return g_doc->Pick(world.x, world.y, PICK_TOLERANCE_PIXELS * g_renderer->WorldPerPixel(), hit);
+}
+
+// Cursor in world coordinates, snapped when something is in reach. While
+// moving, the selection is what follows the cursor, so it is not a target.
+glm::vec2 snapped_cursor(GLFWwindow* window) {
+    double cx, cy;
+    glfwGetCursorPos(window, &cx, &cy);
+    glm::vec2 world = window_to_world(window, cx, cy);
+    SnapResult snap;
+    if (g_doc && snapper.Snap(*g_doc, world.x, world.y, SNAP_TOLERANCE_PIXELS * g_renderer->WorldPerPixel(), snap,
+                              moveDrag.active))
+        return glm::vec2(snap.x, snap.y);
+    return world;
+}
+
+void begin_move(GLFWwindow* window) {
+    if (!g_doc || !g_renderer) return;
+
+    // Grabbing an entity outside the selection moves just that entity
+    EntityRef hit;
+    const std::vector<EntityId>& selection = g_doc->GetSelection();
+    if (pick_at_cursor(window, hit)) {
+        EntityId id = g_doc->IdOf(hit);
+        if (std::find(selection.begin(), selection.end(), id) == selection.end()) g_doc->SetSelection({ id });
+    }
+    if (g_doc->GetSelection().empty()) return;
+
+    moveDrag.active = true;
+    moveDrag.base = snapped_cursor(window);
+}
+
+void end_move(GLFWwindow* window, bool commit) {
+    if (!moveDrag.active) return;
+    glm::vec2 offset = snapped_cursor(window) - moveDrag.base;
+    moveDrag.active = false;
+    g_renderer->ClearPreviewTransform();
+    if (!commit) return;
+
+    g_doc->TranslateEntities(g_doc->SelectionRefs(), offset.x, offset.y);
+}
+
+// Header bar edits act on the whole selection, about the centre of its bounding box
+void apply_edit_command(GUI::EditCommand command) {
+    Bounds box;
+    if (command == GUI::EditCommand::None || moveDrag.active || !g_doc->SelectionBounds(box)) return;
+
+    float px = 0.5f * (box.minX + box.maxX), py = 0.5f * (box.minY + box.maxY);
+    switch (command) {
+    case GUI::EditCommand::Rotate:
+        g_doc->TransformEntities(g_doc->SelectionRefs(), Affine2D::Rotation(90.0f, px, py));
+        break;
+    case GUI::EditCommand::MirrorHorizontal:
+        g_doc->TransformEntities(g_doc->SelectionRefs(), Affine2D::Mirror(true, px, py));
+        break;
+    case GUI::EditCommand::MirrorVertical:
+        g_doc->TransformEntities(g_doc->SelectionRefs(), Affine2D::Mirror(false, px, py));
+        break;
+    default:
+        break;
+    }
+    hoverPending = true;
+}
+
+// Shift adds to the selection; a plain click on empty space clears it
+void click_select(GLFWwindow* window, bool additive) {
+    EntityRef hit;
+    if (pick_at_cursor(window, hit)) {
+        if (additive) g_doc->AddToSelection(g_doc->IdOf(hit));
+        else g_doc->SetSelection({ g_doc->IdOf(hit) });
+    } else if (!additive && g_doc) {
+        g_doc->ClearSelection();
+    }
+}
+
+// Rubber bands follow the CAD convention: dragged to the right they take
+// only what is fully inside, dragged to the left also what they cross
+bool rubber_band_crossing(double x) {
+    return x < selectDrag.startX;
+}
+
+void finish_selection_drag(GLFWwindow* window) {
+    selectDrag.active = false;
+    GUI::SetSelectionOutline({}, {}, false);
+
+    double cx, cy;
+    glfwGetCursorPos(window, &cx, &cy);
+    if (std::abs(cx - selectDrag.startX) < CLICK_SLOP_PIXELS && std::abs(cy - selectDrag.startY) < CLICK_SLOP_PIXELS) {
+        click_select(window, selectDrag.additive);
+        return;
+    }
+    if (!g_renderer || !g_doc) return;
+
+    if (selectDrag.lasso) {
+        std::vector<float> xs, ys;
+        for (size_t i = 0; i < selectDrag.xs.size(); i++) {
+            glm::vec2 p = window_to_world(window, selectDrag.xs[i], selectDrag.ys[i]);
+            xs.push_back(p.x);
+            ys.push_back(p.y);
+        }
+        g_doc->SelectInLasso(xs, ys, SelectMode::Window, selectDrag.additive);
+    } else {
+        glm::vec2 a = window_to_world(window, selectDrag.startX, selectDrag.startY);
+        glm::vec2 b = window_to_world(window, cx, cy);
+        Bounds box{ std::min(a.x, b.x), std::min(a.y, b.y), std::max(a.x, b.x), std::max(a.y, b.y) };
+        g_doc->SelectInBox(box, rubber_band_crossing(cx) ? SelectMode::Crossing : SelectMode::Window,
+                           selectDrag.additive);
+    }
+}
+
+// Hover follows the cursor while the select tool is active, and the snap
+// point always does; both are updated at most once per frame
+void update_cursor(GLFWwindow* window) {
+    if (!hoverPending || !g_doc || !g_renderer) return;
+    hoverPending = false;
+
+    EntityRef hit;
+    if (GUI::GetActiveTool() == GUI::Tool::Select && !ImGui::GetIO().WantCaptureMouse && pick_at_cursor(window, hit))
+        g_doc->SetHover(g_doc->IdOf(hit));
+    else
+        g_doc->ClearHover();
+
+    double cx, cy;
+    glfwGetCursorPos(window, &cx, &cy);
+    glm::vec2 world = window_to_world(window, cx, cy);
+    cursorSnapped = snapper.Snap(*g_doc, world.x, world.y, SNAP_TOLERANCE_PIXELS * g_renderer->WorldPerPixel(),
+                                 cursorSnap, moveDrag.active);
+
+    if (moveDrag.active) {
+        glm::vec2 target = cursorSnapped ? glm::vec2(cursorSnap.x, cursorSnap.y) : world;
+        glm::vec2 offset = target - moveDrag.base;
+        g_renderer->SetPreviewTransform(glm::translate(glm::mat4(1.0f), glm::vec3(offset, 0.0f)));
+    }
+
+    GUI::CursorInfo info;
+    info.worldX = cursorSnapped ? cursorSnap.x : world.x;
+    info.worldY = cursorSnapped ? cursorSnap.y : world.y;
+    if (cursorSnapped) {
+        glm::vec2 marker = world_to_window(window, cursorSnap.x, cursorSnap.y);
+        info.snap = SnapEngine::KindName(cursorSnap.kind);
+        info.markerX = marker.x;
+        info.markerY = marker.y;
+    }
+    GUI::SetCursorInfo(info);
+}
 
 // Mouse scroll to zoom
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-    zoom *= (yoffset > 0) ? 0.9f : 1.1f;
-    zoom = std::clamp(zoom, 1.0f, 1000.0f);
-    if (g_renderer) g_renderer->UpdateCamera(zoom, pan);
+    input.zoomFactor *= (yoffset > 0) ? 0.9f : 1.1f;
+    input.changed = true;
 }
 
-// Left click drag to pan
+// Left click picks with the select tool and pans otherwise; middle drag always pans
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
-    if (button == GLFW_MOUSE_BUTTON_LEFT) {
+    // Clicks on the header bar belong to ImGui
+    if (action == GLFW_PRESS && ImGui::GetIO().WantCaptureMouse) return;
+
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && GUI::GetActiveTool() == GUI::Tool::Select) {
+        selectDrag = SelectionDrag{};
+        selectDrag.active = true;
+        selectDrag.lasso = (mods & GLFW_MOD_ALT) != 0;
+        selectDrag.additive = (mods & GLFW_MOD_SHIFT) != 0;
+        glfwGetCursorPos(window, &selectDrag.startX, &selectDrag.startY);
+        return;
+    }
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE && selectDrag.active) {
+        finish_selection_drag(window);
+        return;
+    }
+
+    // Move tool: left drag moves the selection, right click cancels the drag
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && GUI::GetActiveTool() == GUI::Tool::Move) {
+        begin_move(window);
+        return;
+    }
+    if (moveDrag.active && action == GLFW_RELEASE && button == GLFW_MOUSE_BUTTON_LEFT) {
+        end_move(window, true);
+        return;
+    }
+    if (moveDrag.active && action == GLFW_PRESS && button == GLFW_MOUSE_BUTTON_RIGHT) {
+        end_move(window, false);
+        return;
+    }
+
+    if (button == GLFW_MOUSE_BUTTON_LEFT || button == GLFW_MOUSE_BUTTON_MIDDLE) {
         if (action == GLFW_PRESS) {
             dragging = true;
             glfwGetCursorPos(window, &lastMouseX, &lastMouseY);
@@ -41,26 +290,291 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
     }
 }
 
+// Delete removes the selection; Ctrl+Z undoes; Ctrl+Y or Ctrl+Shift+Z redoes
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action == GLFW_RELEASE || !g_doc || moveDrag.active || ImGui::GetIO().WantCaptureKeyboard) return;
+
+    bool changed = false;
+    if (key == GLFW_KEY_DELETE && action == GLFW_PRESS) {
+        std::vector<EntityId> ids = g_doc->GetSelection();
+        g_doc->DeleteEntities(ids);
+        changed = !ids.empty();
+    } else if (mods & GLFW_MOD_CONTROL) {
+        if (key == GLFW_KEY_Z && !(mods & GLFW_MOD_SHIFT)) changed = g_doc->Undo();
+        else if (key == GLFW_KEY_Y || key == GLFW_KEY_Z) changed = g_doc->Redo();
+    }
+    if (changed) hoverPending = true;
+}
+
 void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos) {
+    hoverPending = true;
+
+    if (selectDrag.active) {
+        SelectionDrag& d = selectDrag;
+        if (d.lasso) {
+            // Skip sub-pixel jitter; every vertex costs a pass over the lasso edges
+            if (d.xs.empty() || std::abs(xpos - d.xs.back()) + std::abs(ypos - d.ys.back()) >= 2.0) {
+                d.xs.push_back((float)xpos);
+                d.ys.push_back((float)ypos);
+            }
+        } else {
+            float x0 = (float)d.startX, y0 = (float)d.startY, x1 = (float)xpos, y1 = (float)ypos;
+            d.xs = { x0, x1, x1, x0 };
+            d.ys = { y0, y0, y1, y1 };
+        }
+        GUI::SetSelectionOutline(d.xs, d.ys, !d.lasso && rubber_band_crossing(xpos));
+        return;
+    }
+
     if (!dragging) return;
 
-    double dx = xpos - lastMouseX;
-    double dy = ypos - lastMouseY;
+    input.dragX += xpos - lastMouseX;
+    input.dragY += ypos - lastMouseY;
+    input.changed = true;
 
     lastMouseX = xpos;
     lastMouseY = ypos;
+}
+
+// Apply everything accumulated since the last frame and rebuild the camera once
+void apply_camera_input(GLFWwindow* window, Renderer& renderer) {
+    if (!input.changed) return;
 
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
 
-    float aspect = (float)width / height;
-    pan.x += dx * (0.95f * zoom * aspect / width);
-    pan.y += dy * (0.95f * zoom / height);
+    if (width > 0 && height > 0) {
+        float aspect = (float)width / height;
+        pan.x += input.dragX * (0.95f * zoom * aspect / width);
+        pan.y += input.dragY * (0.95f * zoom / height);
+    }
+
+    zoom = std::clamp(zoom * input.zoomFactor, 1.0f, 1000.0f);
+
+    renderer.UpdateCamera(zoom, pan);
+    input = InputAccumulator{};
+    hoverPending = true;    // The world under the cursor moved
+}
+
+// Expose/resize: the swapchain contents are stale even if nothing in the scene changed
+void window_refresh_callback(GLFWwindow* window) {
+    if (g_renderer) g_renderer->RequestRedraw();
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+    if (g_renderer) g_renderer->RequestRedraw();
+}
+
+// Fills `doc` with a deterministic pseudo-random board of `count` entities
+// (half tracks, a quarter each of lines and circles) spread over a square
+// of about 2 * extent units
+void generate_board(CADDocument& doc, size_t count, float extent) {
+    uint32_t state = 12345;
+    auto next = [&]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+
+    doc.AddLayer("Pads");
+    doc.BeginBulkLoad();
+    size_t circles = count / 4, tracks = count / 2;
+    for (size_t i = 0; i < tracks; i++) {
+        float x = (next() * 2.0f - 1.0f) * extent;
+        float y = (next() * 2.0f - 1.0f) * extent;
+        doc.AddTrack(0, x, y, x + (next() - 0.5f) * 40.0f, y + (next() - 0.5f) * 40.0f, 0.2f + next());
+    }
+    for (size_t i = 0; i < count - circles - tracks; i++) {
+        float x = (next() * 2.0f - 1.0f) * extent;
+        float y = (next() * 2.0f - 1.0f) * extent;
+        doc.AddLine(0, x, y, x + (next() - 0.5f) * 20.0f, y + (next() - 0.5f) * 20.0f);
+    }
+    for (size_t i = 0; i < circles; i++) {
+        float x = (next() * 2.0f - 1.0f) * extent;
+        float y = (next() * 2.0f - 1.0f) * extent;
+        doc.AddCircle(1, x, y, 0.5f + next() * 4.0f);
+    }
+    doc.EndBulkLoad();
+}
+
+// Binary PPM, so frames can be diffed or viewed without extra dependencies
+void write_ppm(const std::string& path, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("Failed to open " + path);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    for (size_t i = 0; i < (size_t)width * height; i++)
+        file.write(reinterpret_cast<const char*>(&rgba[i * 4]), 3);
+}
+
+// --headless [--frames N] [--entities N] [--out frame.ppm]
+// Renders a generated board without a window and reports frame times
+int run_headless(int argc, char** argv) {
+    int frames = 100;
+    size_t entities = 100000;
+    std::string out_path;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--entities") && i + 1 < argc) entities = (size_t)atoll(argv[++i]);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) out_path = argv[++i];
+    }
+
+    const uint32_t width = 1280, height = 720;
+    Renderer renderer;
+    renderer.InitHeadless(width, height);
+
+    const float extent = 1000.0f;
+    CADDocument doc;
+    generate_board(doc, entities, extent);
+    renderer.UpdateCamera(extent, glm::vec2(0.0f));
+
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+    // First frame includes tessellation and the initial upload
+    auto start = clock::now();
+    renderer.RenderFrame(doc);
+    vkQueueWaitIdle(renderer.GetQueue());
+    double first_ms = ms(clock::now() - start);
+
+    // Pan a little every frame so culling and LOD selection are exercised
+    start = clock::now();
+    for (int i = 0; i < frames; i++) {
+        float t = (float)i / frames;
+        renderer.UpdateCamera(extent * (1.0f - 0.9f * t), glm::vec2(t * extent * 0.5f, 0.0f));
+        renderer.RenderFrame(doc);
+    }
+    vkQueueWaitIdle(renderer.GetQueue());
+    double total_ms = ms(clock::now() - start);
+
+    std::cout << "entities: " << entities << "\n"
+              << "first frame (tessellation + upload): " << first_ms << " ms\n"
+              << "steady frames: " << frames << ", avg " << total_ms / frames << " ms\n";
+
+    if (!out_path.empty()) {
+        std::vector<uint8_t> rgba;
+        renderer.ReadbackFrame(rgba);
+        write_ppm(out_path, rgba, width, height);
+        std::cout << "frame written to " << out_path << "\n";
+    }
+
+    renderer.Cleanup();
+    return 0;
+}
+
+// Straightforward per-entity versions of the selection tests, as a baseline
+// for the batch kernels
+static Containment naive_segment_in_box(float x1, float y1, float x2, float y2, const Bounds& b) {
+    auto inside = [&](float x, float y) { return x >= b.minX && x <= b.maxX && y >= b.minY && y <= b.maxY; };
+    bool in1 = inside(x1, y1), in2 = inside(x2, y2);
+    if (in1 && in2) return Containment::Inside;
+    if (in1 || in2) return Containment::Crossing;
+    if (std::max(x1, x2) < b.minX || std::min(x1, x2) > b.maxX || std::max(y1, y2) < b.minY || std::min(y1, y2) > b.maxY)
+        return Containment::Outside;
+    float cx[4] = { b.minX, b.maxX, b.maxX, b.minX }, cy[4] = { b.minY, b.minY, b.maxY, b.maxY };
+    int positive = 0, negative = 0;
+    for (int k = 0; k < 4; k++) {
+        float side = (x2 - x1) * (cy[k] - y1) - (y2 - y1) * (cx[k] - x1);
+        positive += side > 0.0f;
+        negative += side < 0.0f;
+    }
+    return (positive == 4 || negative == 4) ? Containment::Outside : Containment::Crossing;
+}
+
+static Containment naive_segment_in_lasso(float x1, float y1, float x2, float y2,
+                                          const std::vector<float>& xs, const std::vector<float>& ys) {
+    bool in1 = false, in2 = false, cross = false;
+    for (size_t i = 0, j = xs.size() - 1; i < xs.size(); j = i++) {
+        float ax = xs[j], ay = ys[j], bx = xs[i], by = ys[i];
+        if ((ay > y1) != (by > y1) && x1 < ax + (y1 - ay) * (bx - ax) / (by - ay)) in1 = !in1;
+        if ((ay > y2) != (by > y2) && x2 < ax + (y2 - ay) * (bx - ax) / (by - ay)) in2 = !in2;
+        float d1 = (bx - ax) * (y1 - ay) - (by - ay) * (x1 - ax);
+        float d2 = (bx - ax) * (y2 - ay) - (by - ay) * (x2 - ax);
+        float d3 = (x2 - x1) * (ay - y1) - (y2 - y1) * (ax - x1);
+        float d4 = (x2 - x1) * (by - y1) - (y2 - y1) * (bx - x1);
+        if (d1 * d2 < 0.0f && d3 * d4 < 0.0f) cross = true;
+    }
+    if (in1 && in2 && !cross) return Containment::Inside;
+    return (in1 || in2 || cross) ? Containment::Crossing : Containment::Outside;
+}
+
+// --bench-select [--entities N]
+// Times rubber band and lasso classification of the board's segments:
+// a naive loop against the batch kernel on every available instruction set.
+// Fails if any kernel disagrees with the naive loop.
+int run_select_bench(int argc, char** argv) {
+    size_t entities = 1000000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--entities") && i + 1 < argc) entities = (size_t)atoll(argv[++i]);
+    }
+
+    const float extent = 1000.0f;
+    CADDocument doc;
+    generate_board(doc, entities, extent);
+    const TrackArrays& t = doc.GetLayers()[0].tracks;
+    size_t count = t.Size();
+    SegmentSpan span{ t.x1.data(), t.y1.data(), t.x2.data(), t.y2.data() };
+
+    // A box over a quarter of the board, and a 64-gon lasso of similar area
+    Bounds box{ -extent * 0.5f, -extent * 0.5f, extent * 0.5f, extent * 0.5f };
+    std::vector<float> xs, ys;
+    for (int i = 0; i < 64; i++) {
+        float a = i * 6.2831853f / 64.0f, r = extent * (0.5f + 0.1f * std::sin(a * 5.0f));
+        xs.push_back(r * std::cos(a));
+        ys.push_back(r * std::sin(a));
+    }
+
+    using clock = std::chrono::steady_clock;
+    const int runs = 10;
+    std::vector<Containment> out(count);
+    auto time_ms = [&](auto&& fn) {
+        auto start = clock::now();
+        for (int r = 0; r < runs; r++) fn();
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count() / runs;
+    };
+    auto report = [&](const char* name, double box_ms, double lasso_ms) {
+        std::cout << name << ": box " << box_ms << " ms, lasso " << lasso_ms << " ms\n";
+    };
+
+    // The naive results are the reference every kernel is checked against
+    std::vector<Containment> box_ref(count), lasso_ref(count);
+    auto mismatches = [&](const std::vector<Containment>& ref) {
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) n += out[i] != ref[i];
+        return n;
+    };
 
-    if (g_renderer) g_renderer->UpdateCamera(zoom, pan);
+    std::cout << "segments: " << count << "\n";
+    report("naive", time_ms([&] {
+        for (size_t i = 0; i < count; i++) box_ref[i] = naive_segment_in_box(t.x1[i], t.y1[i], t.x2[i], t.y2[i], box);
+    }), time_ms([&] {
+        for (size_t i = 0; i < count; i++) lasso_ref[i] = naive_segment_in_lasso(t.x1[i], t.y1[i], t.x2[i], t.y2[i], xs, ys);
+    }));
+
+    bool ok = true;
+    SelectionKernel::Isa best = SelectionKernel::GetIsa();
+    for (SelectionKernel::Isa isa : { SelectionKernel::Isa::Scalar, SelectionKernel::Isa::Sse, SelectionKernel::Isa::Avx2 }) {
+        if (isa > best) break;
+        SelectionKernel::SetIsa(isa);
+        double box_ms = time_ms([&] { SelectionKernel::ClassifyBox(span, count, box, out.data()); });
+        size_t box_bad = mismatches(box_ref);
+        double lasso_ms = time_ms([&] { SelectionKernel::ClassifyLasso(span, count, xs.data(), ys.data(), xs.size(), out.data()); });
+        size_t lasso_bad = mismatches(lasso_ref);
+        report(SelectionKernel::IsaName(isa), box_ms, lasso_ms);
+        if (box_bad || lasso_bad) {
+            std::cerr << SelectionKernel::IsaName(isa) << ": " << box_bad << " box and " << lasso_bad
+                      << " lasso results differ from the naive loop\n";
+            ok = false;
+        }
+    }
+    SelectionKernel::SetIsa(best);
+    return ok ? 0 : 1;
 }
 
-int main() {
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--headless")) return run_headless(argc, argv);
+        if (!strcmp(argv[i], "--bench-select")) return run_select_bench(argc, argv);
+    }
+
     if (!glfwInit()) throw std::runtime_error("GLFW init failed!");
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     GLFWwindow* window = glfwCreateWindow(1280, 720, "TCADO", nullptr, nullptr);
@@ -69,6 +583,9 @@ int main() {
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetCursorPosCallback(window, cursor_pos_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     // ----- Init Renderer -----
     Renderer renderer;
@@ -79,9 +596,12 @@ int main() {
     // ----- Init GUI Header -----
     GUI::Init(window, renderer.GetInstance(), renderer.GetDevice(), renderer.GetPhysicalDevice(),
               renderer.GetQueueFamily(), renderer.GetQueue(), renderer.GetRenderPass());
+    renderer.SetRenderPassChangedCallback(GUI::SetRenderPass);
 
     // ----- Create CAD Document -----
     CADDocument doc;
+    g_doc = &doc;
+    snapper.SetGrid(1.0f);
 
     auto line = std::make_shared<LineEntity>(0.0f, 0.0f, 25.0f, 100.0f);
     doc.AddEntityToLayer(0, line);
@@ -89,15 +609,33 @@ int main() {
     doc.AddEntityToLayer(0, line);
     auto circle = std::make_shared<CircleEntity>(50.0f, 50.0f, 25.0f);
     doc.AddEntityToLayer(0, circle);
+    auto track = std::make_shared<TrackEntity>(-50.0f, -50.0f, 50.0f, 50.0f, 6.0f);
+    doc.AddEntityToLayer(0, track);
+    doc.ClearHistory();     // The starting content is not an edit
+    gui::Toolbar menu_bar(doc);
+
+    // Render on demand: when the last frame changed nothing, block for input instead
+    // of spinning. The timeout keeps ImGui's time-based state (tooltips, caret) ticking.
+    constexpr double IDLE_WAIT_SECONDS = 0.25;
+    bool idle = false;
 
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
-        GUI::RenderHeader();
-        renderer.RenderFrame(doc);
+        if (idle) glfwWaitEventsTimeout(IDLE_WAIT_SECONDS);
+        else glfwPollEvents();
+        apply_camera_input(window, renderer);
+
+        update_cursor(window);
+        GUI::RenderHeader(&menu_bar);
+        apply_edit_command(GUI::TakeEditCommand());
+        bool gui_changed = GUI::NeedsRedraw();
+
+        idle = !gui_changed && !renderer.NeedsRedraw(doc);
+        if (!idle) renderer.RenderFrame(doc);
     }
 
     // ----- Cleanup -----
     vkDeviceWaitIdle(renderer.GetDevice());
+    g_doc = nullptr;
 
     GUI::Cleanup();
     renderer.Cleanup();
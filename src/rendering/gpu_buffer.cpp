@@ -0,0 +1,172 @@
+// gpu_buffer.cpp
+
+#include "rendering/gpu_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    constexpr VkDeviceSize MIN_STAGING_SIZE = 1 << 20;
+
+    void check(VkResult err) {
+        if (err != VK_SUCCESS)
+            throw std::runtime_error("Vulkan buffer operation failed (VkResult = " + std::to_string(err) + ")");
+    }
+}
+
+void BufferUploader::Init(VkDevice device_, VkPhysicalDevice physicalDevice, uint32_t frameCount) {
+    device = device_;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    slots.resize(frameCount);
+    currentSlot = 0;
+}
+
+void BufferUploader::Destroy() {
+    for (auto& slot : slots) {
+        for (auto& buf : slot.retired)
+            destroyBuffer(buf);
+        slot.retired.clear();
+
+        if (slot.buffer != VK_NULL_HANDLE) {
+            vkUnmapMemory(device, slot.memory);
+            vkDestroyBuffer(device, slot.buffer, nullptr);
+            vkFreeMemory(device, slot.memory, nullptr);
+        }
+        slot = StagingSlot{};
+    }
+    pending.clear();
+}
+
+void BufferUploader::BeginFrame(uint32_t frame) {
+    currentSlot = frame;
+    StagingSlot& slot = slots[currentSlot];
+    for (auto& buf : slot.retired)
+        destroyBuffer(buf);
+    slot.retired.clear();
+}
+
+bool BufferUploader::Reserve(GpuBuffer& buf, VkDeviceSize size, VkBufferUsageFlags usage) {
+    if (size <= buf.capacity) return false;
+
+    // Grow geometrically so a slowly growing document reallocates rarely
+    VkDeviceSize capacity = std::max(size, buf.capacity + buf.capacity / 2);
+
+    Release(buf);
+    createBuffer(capacity, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                 buf.buffer, buf.memory);
+    buf.capacity = capacity;
+    return true;
+}
+
+void BufferUploader::Upload(GpuBuffer& buf, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    if (size == 0) return;
+    pending.push_back({ buf.buffer, offset, data, size });
+}
+
+void BufferUploader::Flush(VkCommandBuffer cmd) {
+    if (pending.empty()) return;
+
+    // Each copy starts at a 16-byte aligned staging offset
+    VkDeviceSize total = 0;
+    for (const auto& copy : pending)
+        total = ((total + 15) & ~VkDeviceSize(15)) + copy.size;
+
+    StagingSlot& slot = slots[currentSlot];
+    if (total > slot.capacity)
+        growStaging(slot, total);
+
+    // Earlier frames may still be fetching vertices from the ranges we overwrite
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    // Group regions by destination so each buffer gets one vkCmdCopyBuffer
+    std::stable_sort(pending.begin(), pending.end(),
+        [](const PendingCopy& a, const PendingCopy& b) { return a.dst < b.dst; });
+
+    VkDeviceSize stagingOffset = 0;
+    size_t i = 0;
+    while (i < pending.size()) {
+        VkBuffer dst = pending[i].dst;
+        regions.clear();
+        for (; i < pending.size() && pending[i].dst == dst; ++i) {
+            const PendingCopy& copy = pending[i];
+            stagingOffset = (stagingOffset + 15) & ~VkDeviceSize(15);
+            memcpy(static_cast<char*>(slot.mapped) + stagingOffset, copy.data, (size_t)copy.size);
+            regions.push_back({ stagingOffset, copy.dstOffset, copy.size });
+            stagingOffset += copy.size;
+        }
+        vkCmdCopyBuffer(cmd, slot.buffer, dst, (uint32_t)regions.size(), regions.data());
+    }
+    pending.clear();
+
+    // Make the copies visible to vertex fetch of this and later submissions
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void BufferUploader::Release(GpuBuffer& buf) {
+    if (buf.buffer != VK_NULL_HANDLE)
+        slots[currentSlot].retired.push_back(buf);
+    buf = GpuBuffer{};
+}
+
+uint32_t BufferUploader::FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) &&
+            (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    throw std::runtime_error("Failed to find suitable memory type for buffer!");
+}
+
+void BufferUploader::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                                  VkBuffer& buffer, VkDeviceMemory& memory) {
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    check(vkCreateBuffer(device, &buffer_info, nullptr, &buffer));
+
+    VkMemoryRequirements mem_requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &mem_requirements);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_requirements.size;
+    alloc_info.memoryTypeIndex = FindMemoryType(mem_requirements.memoryTypeBits, properties);
+
+    check(vkAllocateMemory(device, &alloc_info, nullptr, &memory));
+    check(vkBindBufferMemory(device, buffer, memory, 0));
+}
+
+void BufferUploader::growStaging(StagingSlot& slot, VkDeviceSize size) {
+    // The slot's last submission has completed (see BeginFrame), so it can go right away
+    if (slot.buffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(device, slot.memory);
+        vkDestroyBuffer(device, slot.buffer, nullptr);
+        vkFreeMemory(device, slot.memory, nullptr);
+    }
+
+    VkDeviceSize capacity = std::max(MIN_STAGING_SIZE, slot.capacity);
+    while (capacity < size) capacity *= 2;
+
+    createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 slot.buffer, slot.memory);
+    check(vkMapMemory(device, slot.memory, 0, capacity, 0, &slot.mapped));
+    slot.capacity = capacity;
+}
+
+void BufferUploader::destroyBuffer(GpuBuffer& buf) {
+    if (buf.buffer != VK_NULL_HANDLE) vkDestroyBuffer(device, buf.buffer, nullptr);
+    if (buf.memory != VK_NULL_HANDLE) vkFreeMemory(device, buf.memory, nullptr);
+    buf = GpuBuffer{};
+}
@@ -0,0 +1,70 @@
+// gpu_buffer.h
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Device-local buffer that is only reallocated when it has to grow
+struct GpuBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize capacity = 0;
+};
+
+// Streams CPU data into GpuBuffers through a host-visible staging slot
+// per frame in flight. Uploads are queued during the frame and recorded
+// as vkCmdCopyBuffer regions by Flush, before the render pass begins.
+class BufferUploader {
+public:
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount);
+    void Destroy();
+
+    // Call once the fence of `frame` has signalled: its staging slot and
+    // any buffers retired while it was recording can be reused/freed.
+    void BeginFrame(uint32_t frame);
+
+    // Makes room for `size` bytes. Returns true when the buffer was
+    // (re)allocated, in which case its previous contents are gone.
+    bool Reserve(GpuBuffer& buf, VkDeviceSize size, VkBufferUsageFlags usage);
+
+    // Queues a copy of `size` bytes from `data` into `buf` at `offset`.
+    // `data` must stay valid until Flush.
+    void Upload(GpuBuffer& buf, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+    // Records all queued copies into `cmd` (outside any render pass)
+    void Flush(VkCommandBuffer cmd);
+
+    // Frees the buffer once no in-flight frame can still be reading it
+    void Release(GpuBuffer& buf);
+
+    uint32_t FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+
+private:
+    struct StagingSlot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize capacity = 0;
+        void* mapped = nullptr;
+        std::vector<GpuBuffer> retired;
+    };
+
+    struct PendingCopy {
+        VkBuffer dst;
+        VkDeviceSize dstOffset;
+        const void* data;
+        VkDeviceSize size;
+    };
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                      VkBuffer& buffer, VkDeviceMemory& memory);
+    void growStaging(StagingSlot& slot, VkDeviceSize size);
+    void destroyBuffer(GpuBuffer& buf);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    std::vector<StagingSlot> slots;
+    uint32_t currentSlot = 0;
+    std::vector<PendingCopy> pending;
+    std::vector<VkBufferCopy> regions;
+};
@@ -0,0 +1,106 @@
+// pipeline_cache.cpp
+
+#include "rendering/pipeline_cache.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    constexpr uint32_t CACHE_MAGIC = 0x43504354; // "TCPC"
+}
+
+std::string PipelineCache::cachePath() {
+    // Per-user cache directory, so the binary works from any working directory
+    namespace fs = std::filesystem;
+    fs::path dir;
+    if (const char* local = std::getenv("LOCALAPPDATA")) dir = fs::path(local) / "TCADO";
+    else if (const char* xdg = std::getenv("XDG_CACHE_HOME")) dir = fs::path(xdg) / "tcado";
+    else if (const char* home = std::getenv("HOME")) dir = fs::path(home) / ".cache" / "tcado";
+    else dir = fs::temp_directory_path() / "tcado";
+    return (dir / "pipeline_cache.bin").string();
+}
+
+PipelineCache::FileHeader PipelineCache::makeHeader() const {
+    FileHeader header = {};
+    header.magic = CACHE_MAGIC;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    memcpy(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    return header;
+}
+
+void PipelineCache::Init(VkDevice device_, VkPhysicalDevice physicalDevice) {
+    device = device_;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // A missing, truncated or foreign file just means starting from an empty cache
+    std::vector<char> data;
+    std::ifstream file(cachePath(), std::ios::binary);
+    if (file.is_open()) {
+        FileHeader expected = makeHeader(), header = {};
+        if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+            memcmp(&header, &expected, offsetof(FileHeader, dataSize)) == 0) {
+            data.resize((size_t)header.dataSize);
+            if (!file.read(data.data(), data.size())) data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.initialDataSize = data.size();
+    cache_info.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(device, &cache_info, nullptr, &cache) != VK_SUCCESS) {
+        // Drivers may still reject data they consider stale
+        cache_info.initialDataSize = 0;
+        cache_info.pInitialData = nullptr;
+        if (vkCreatePipelineCache(device, &cache_info, nullptr, &cache) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create pipeline cache!");
+    }
+}
+
+void PipelineCache::Save() {
+    if (cache == VK_NULL_HANDLE) return;
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0) return;
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) return;
+
+    FileHeader header = makeHeader();
+    header.dataSize = size;
+
+    // Write next to the target and rename, so a crash never leaves a torn file
+    namespace fs = std::filesystem;
+    fs::path path = cachePath();
+    fs::path temp = path;
+    temp += ".tmp";
+
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "[PipelineCache] Cannot write " << temp.string() << std::endl;
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(data.data(), size);
+        if (!file) return;
+    }
+    fs::rename(temp, path, ec);
+    if (ec) std::cerr << "[PipelineCache] Cannot replace " << path.string() << ": " << ec.message() << std::endl;
+}
+
+void PipelineCache::Destroy() {
+    if (cache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
@@ -0,0 +1,37 @@
+// pipeline_cache.h
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+
+// VkPipelineCache persisted between runs. The file is keyed by the
+// device's pipelineCacheUUID, vendor/device IDs and driver version;
+// data written by any other device or driver is ignored.
+class PipelineCache {
+public:
+    void Init(VkDevice device, VkPhysicalDevice physicalDevice);
+    void Save();
+    void Destroy();
+
+    VkPipelineCache Get() const { return cache; }
+
+private:
+    // Written in front of the Vulkan cache blob
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t uuid[VK_UUID_SIZE];
+        uint64_t dataSize;
+    };
+
+    static std::string cachePath();
+    FileHeader makeHeader() const;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    VkPipelineCache cache = VK_NULL_HANDLE;
+};
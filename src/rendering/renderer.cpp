@@ -10,12 +10,54 @@
 
 #include <iostream>
 #include <algorithm>
-#include <fstream>
+#include <cfloat>
+#include <cstring>
+#include <stdexcept>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+// SPIR-V generated from shaders/*.glsl at build time (see CMakeLists.txt)
+#include "shaders/vert.spv.h"
+#include "shaders/frag.spv.h"
+#include "shaders/circle_vert.spv.h"
+#include "shaders/circle_frag.spv.h"
+#include "shaders/track_vert.spv.h"
+#include "shaders/track_frag.spv.h"
+
 glm::mat4 viewProjMatrix = glm::mat4(1.0f);
 
+template <size_t N>
+static constexpr size_t spirvSize(const uint32_t (&)[N]) { return N * sizeof(uint32_t); }
+
+// Circle level-of-detail buckets, picked by on-screen radius in pixels.
+// Segment counts keep the ring within about a pixel of the outline.
+struct CircleLod {
+    float maxScreenRadius;
+    uint32_t segments;
+};
+
+static constexpr CircleLod CIRCLE_LODS[] = {
+    { 8.0f, 0 },        // Small enough that a quad is cheapest
+    { 32.0f, 16 },
+    { 128.0f, 32 },
+    { 512.0f, 64 },
+    { 2048.0f, 128 },
+    { FLT_MAX, 256 },
+};
+static constexpr size_t CIRCLE_LOD_COUNT = sizeof(CIRCLE_LODS) / sizeof(CIRCLE_LODS[0]);
+
+// RGBA8 packed little-endian (0xAABBGGRR), as unpackUnorm4x8 expects
+static constexpr uint32_t DEFAULT_PALETTE[PALETTE_SIZE] = {
+    0xff0000ff,     // PALETTE_LINE: red
+    0xff00ff00,     // PALETTE_CIRCLE: green
+    0xff3380d9,     // PALETTE_TRACK: copper
+    0xff00ffff,     // PALETTE_SELECTION: yellow
+    0xffffff00,     // PALETTE_HOVER: cyan
+    0xffff00ff,
+    0xff808080,
+    0xffffffff,
+};
+
 void Renderer::check_vk_result(VkResult err) {
     if (err == 0) return;
     std::cerr << "[Vulkan Error] VkResult = " << err << std::endl;
@@ -24,11 +66,14 @@ void Renderer::check_vk_result(VkResult err) {
 
 void Renderer::Init(GLFWwindow* w) {
     window = w;
+    std::copy(std::begin(DEFAULT_PALETTE), std::end(DEFAULT_PALETTE), palette);
     createInstance();
     check_vk_result(glfwCreateWindowSurface(instance, window, nullptr, &surface));
 
     pickPhysicalDevice();
     createDevice();
+    uploader.Init(device, physical_device, FRAME_COUNT);
+    pipeline_cache.Init(device, physical_device);
     createSwapchain(window);
     createRenderPass();
     createPipeline();
@@ -38,6 +83,23 @@ void Renderer::Init(GLFWwindow* w) {
     createSyncObjects();
 }
 
+void Renderer::InitHeadless(uint32_t width, uint32_t height) {
+    headless = true;
+    std::copy(std::begin(DEFAULT_PALETTE), std::end(DEFAULT_PALETTE), palette);
+    createInstance();
+
+    pickPhysicalDevice();
+    createDevice();
+    uploader.Init(device, physical_device, FRAME_COUNT);
+    pipeline_cache.Init(device, physical_device);
+    createOffscreenTargets(width, height);
+    createRenderPass();
+    createPipeline();
+    createFramebuffers();
+    createCommandPool();
+    createSyncObjects();
+}
+
 void Renderer::RecreateSwapchain() {
     int width = 0, height = 0;
     while (width == 0 || height == 0) {
@@ -51,29 +113,145 @@ void Renderer::RecreateSwapchain() {
         vkDestroyFramebuffer(device, framebuffer, nullptr);
     for (auto view : swapchain_image_views)
         vkDestroyImageView(device, view, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-    vkDestroyRenderPass(device, render_pass, nullptr);
-    vkDestroySwapchainKHR(device, swapchain, nullptr);
 
+    // Viewport and scissor are dynamic, so the render pass and pipelines only
+    // depend on the surface format and normally survive a resize
+    VkFormat old_format = swapchain_image_format;
     createSwapchain(window);
-    createRenderPass();
-    createPipeline();
+    if (swapchain_image_format != old_format) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipeline(device, circle_pipeline, nullptr);
+        vkDestroyPipeline(device, track_pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+        vkDestroyRenderPass(device, render_pass, nullptr);
+        createRenderPass();
+        createPipeline();
+        if (renderPassChanged) renderPassChanged(render_pass);
+    }
     createFramebuffers();
-    markAllDirty();
+    updateViewProj();       // The aspect ratio may have changed
+
+    // Geometry is untouched; only the frame itself is stale
+    redrawRequested = true;
 }
 
 
 void Renderer::createPipeline() {
-    // Load shaders
-    VkShaderModule vert_shader_module = loadShaderModule("src/rendering/shaders/vert.spv");
-    VkShaderModule frag_shader_module = loadShaderModule("src/rendering/shaders/frag.spv");
-
-    // Shader stages
+    // Shared by every scene pipeline; each shader reads the prefix it needs
     VkPushConstantRange push_constant_range = {};
     push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     push_constant_range.offset = 0;
-    push_constant_range.size = sizeof(glm::mat4);
+    push_constant_range.size = sizeof(CameraPushConstants);
+
+    // Pipeline layout
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+    check_vk_result(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout));
+
+    // Lines: one vertex per endpoint
+    VkVertexInputBindingDescription line_binding = {};
+    line_binding.binding = 0;
+    line_binding.stride = sizeof(Vertex);
+    line_binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    // Quantized position arrives as 0..1 and is scaled by the chunk box in the shader
+    VkVertexInputAttributeDescription line_attrs[2] = {};
+    line_attrs[0].binding = 0;
+    line_attrs[0].location = 0;
+    line_attrs[0].format = VK_FORMAT_R16G16_UNORM;
+    line_attrs[0].offset = offsetof(Vertex, pos);
+
+    line_attrs[1].binding = 0;
+    line_attrs[1].location = 1;
+    line_attrs[1].format = VK_FORMAT_R16_UINT;
+    line_attrs[1].offset = offsetof(Vertex, colorIndex);
+
+    PipelineDesc line_desc;
+    line_desc.vertShader = { vert_spv, spirvSize(vert_spv) };
+    line_desc.fragShader = { frag_spv, spirvSize(frag_spv) };
+    line_desc.binding = line_binding;
+    line_desc.attributes = line_attrs;
+    line_desc.attributeCount = 2;
+    line_desc.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    line_desc.blend = false;
+    pipeline = buildPipeline(line_desc);
+
+    // Circles: one instance per circle, quad corners generated in the shader
+    VkVertexInputBindingDescription circle_binding = {};
+    circle_binding.binding = 0;
+    circle_binding.stride = sizeof(CircleInstance);
+    circle_binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    VkVertexInputAttributeDescription circle_attrs[3] = {};
+    circle_attrs[0].binding = 0;
+    circle_attrs[0].location = 0;
+    circle_attrs[0].format = VK_FORMAT_R32G32_SFLOAT;
+    circle_attrs[0].offset = offsetof(CircleInstance, center);
+
+    circle_attrs[1].binding = 0;
+    circle_attrs[1].location = 1;
+    circle_attrs[1].format = VK_FORMAT_R32_SFLOAT;
+    circle_attrs[1].offset = offsetof(CircleInstance, radius);
+
+    circle_attrs[2].binding = 0;
+    circle_attrs[2].location = 2;
+    circle_attrs[2].format = VK_FORMAT_R32_UINT;
+    circle_attrs[2].offset = offsetof(CircleInstance, colorIndex);
+
+    PipelineDesc circle_desc;
+    circle_desc.vertShader = { circle_vert_spv, spirvSize(circle_vert_spv) };
+    circle_desc.fragShader = { circle_frag_spv, spirvSize(circle_frag_spv) };
+    circle_desc.binding = circle_binding;
+    circle_desc.attributes = circle_attrs;
+    circle_desc.attributeCount = 3;
+    circle_desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    circle_desc.blend = true;
+    circle_pipeline = buildPipeline(circle_desc);
+
+    // Tracks: one instance per segment, capsule cut out in the fragment shader
+    VkVertexInputBindingDescription track_binding = {};
+    track_binding.binding = 0;
+    track_binding.stride = sizeof(TrackInstance);
+    track_binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    VkVertexInputAttributeDescription track_attrs[4] = {};
+    track_attrs[0].binding = 0;
+    track_attrs[0].location = 0;
+    track_attrs[0].format = VK_FORMAT_R32G32_SFLOAT;
+    track_attrs[0].offset = offsetof(TrackInstance, p0);
+
+    track_attrs[1].binding = 0;
+    track_attrs[1].location = 1;
+    track_attrs[1].format = VK_FORMAT_R32G32_SFLOAT;
+    track_attrs[1].offset = offsetof(TrackInstance, p1);
+
+    track_attrs[2].binding = 0;
+    track_attrs[2].location = 2;
+    track_attrs[2].format = VK_FORMAT_R32_SFLOAT;
+    track_attrs[2].offset = offsetof(TrackInstance, halfWidth);
+
+    track_attrs[3].binding = 0;
+    track_attrs[3].location = 3;
+    track_attrs[3].format = VK_FORMAT_R32_UINT;
+    track_attrs[3].offset = offsetof(TrackInstance, colorIndex);
+
+    PipelineDesc track_desc;
+    track_desc.vertShader = { track_vert_spv, spirvSize(track_vert_spv) };
+    track_desc.fragShader = { track_frag_spv, spirvSize(track_frag_spv) };
+    track_desc.binding = track_binding;
+    track_desc.attributes = track_attrs;
+    track_desc.attributeCount = 4;
+    track_desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    track_desc.blend = true;
+    track_pipeline = buildPipeline(track_desc);
+}
+
+VkPipeline Renderer::buildPipeline(const PipelineDesc& desc) {
+    // Load shaders
+    VkShaderModule vert_shader_module = createShaderModule(desc.vertShader.code, desc.vertShader.size);
+    VkShaderModule frag_shader_module = createShaderModule(desc.fragShader.code, desc.fragShader.size);
 
     VkPipelineShaderStageCreateInfo vert_stage_info = {};
     vert_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -90,54 +268,30 @@ void Renderer::createPipeline() {
     VkPipelineShaderStageCreateInfo shader_stages[] = { vert_stage_info, frag_stage_info };
 
     // Vertex input
-    VkVertexInputBindingDescription binding_desc = {};
-    binding_desc.binding = 0;
-    binding_desc.stride = sizeof(Vertex);
-    binding_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    VkVertexInputAttributeDescription attr_desc[2] = {};
-    attr_desc[0].binding = 0;
-    attr_desc[0].location = 0;
-    attr_desc[0].format = VK_FORMAT_R32G32_SFLOAT;
-    attr_desc[0].offset = offsetof(Vertex, pos);
-
-    attr_desc[1].binding = 0;
-    attr_desc[1].location = 1;
-    attr_desc[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attr_desc[1].offset = offsetof(Vertex, color);
-
     VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
     vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     vertex_input_info.vertexBindingDescriptionCount = 1;
-    vertex_input_info.pVertexBindingDescriptions = &binding_desc;
-    vertex_input_info.vertexAttributeDescriptionCount = 2;
-    vertex_input_info.pVertexAttributeDescriptions = attr_desc;
+    vertex_input_info.pVertexBindingDescriptions = &desc.binding;
+    vertex_input_info.vertexAttributeDescriptionCount = desc.attributeCount;
+    vertex_input_info.pVertexAttributeDescriptions = desc.attributes;
 
     // Input assembly
     VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
     input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    input_assembly.topology = desc.topology;
     input_assembly.primitiveRestartEnable = VK_FALSE;
 
-    // Viewport and scissor
-    VkViewport viewport = {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swapchain_extent.width;
-    viewport.height = (float)swapchain_extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor = {};
-    scissor.offset = { 0, 0 };
-    scissor.extent = swapchain_extent;
-
+    // Viewport and scissor are set per frame, so resizing never invalidates the pipeline
     VkPipelineViewportStateCreateInfo viewport_state = {};
     viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewport_state.viewportCount = 1;
-    viewport_state.pViewports = &viewport;
     viewport_state.scissorCount = 1;
-    viewport_state.pScissors = &scissor;
+
+    VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamic_state = {};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.pDynamicStates = dynamic_states;
 
     // Rasterizer
     VkPipelineRasterizationStateCreateInfo rasterizer = {};
@@ -155,12 +309,18 @@ void Renderer::createPipeline() {
     multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-    // Color blend
+    // Color blend (alpha blending for shaders that compute edge coverage)
     VkPipelineColorBlendAttachmentState color_blend_attachment = {};
     color_blend_attachment.colorWriteMask =
         VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
         VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment.blendEnable = VK_FALSE;
+    color_blend_attachment.blendEnable = desc.blend ? VK_TRUE : VK_FALSE;
+    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
 
     VkPipelineColorBlendStateCreateInfo color_blending = {};
     color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -168,17 +328,8 @@ void Renderer::createPipeline() {
     color_blending.attachmentCount = 1;
     color_blending.pAttachments = &color_blend_attachment;
 
-    // Pipeline layout
-    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
-    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_info.pushConstantRangeCount = 1;
-    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
-    check_vk_result(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout));
-
-
     // Final pipeline
     VkGraphicsPipelineCreateInfo pipeline_info = {};
-    pipeline_info.layout = pipeline_layout;
     pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipeline_info.stageCount = 2;
     pipeline_info.pStages = shader_stages;
@@ -188,30 +339,38 @@ void Renderer::createPipeline() {
     pipeline_info.pRasterizationState = &rasterizer;
     pipeline_info.pMultisampleState = &multisampling;
     pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
     pipeline_info.layout = pipeline_layout;
     pipeline_info.renderPass = render_pass;
     pipeline_info.subpass = 0;
 
-    check_vk_result(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline));
+    VkPipeline result = VK_NULL_HANDLE;
+    check_vk_result(vkCreateGraphicsPipelines(device, pipeline_cache.Get(), 1, &pipeline_info, nullptr, &result));
 
     // Destroy shader modules (no longer needed after pipeline is created)
     vkDestroyShaderModule(device, vert_shader_module, nullptr);
     vkDestroyShaderModule(device, frag_shader_module, nullptr);
+    return result;
 }
 
 void Renderer::RenderFrame(const CADDocument& doc) {
     vkWaitForFences(device, 1, &frame_fences[frame_index], VK_TRUE, UINT64_MAX);
-    vkResetFences(device, 1, &frame_fences[frame_index]);
 
-    uint32_t image_index;
-    VkResult acquire_result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX,
-        image_acquired_semaphores[frame_index], VK_NULL_HANDLE, &image_index);
+    // Headless frames own one offscreen image each; nothing to acquire
+    uint32_t image_index = frame_index;
+    if (!headless) {
+        VkResult acquire_result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX,
+            image_acquired_semaphores[frame_index], VK_NULL_HANDLE, &image_index);
 
-    if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
-        RecreateSwapchain();
-        return;
+        if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
+            RecreateSwapchain();
+            return;
+        }
     }
 
+    // Only reset once a submit is certain, or a skipped frame would leave the fence unsignalled
+    vkResetFences(device, 1, &frame_fences[frame_index]);
+
     VkCommandBuffer cmd = command_buffers[frame_index];
 
     VkCommandBufferBeginInfo begin_info = {};
@@ -229,71 +388,53 @@ void Renderer::RenderFrame(const CADDocument& doc) {
     render_pass_info.clearValueCount = 1;
     render_pass_info.pClearValues = &clear_value;
 
-    if (sceneDirty) {
-        vertices.clear();
-        for (const auto& layer : doc.GetLayers()) {
-            if (!layer.visible) continue;
-            for (const auto& entity : layer.entities) {
-                std::string type = entity->GetType();
-                if (type == "Line") {
-                    const LineEntity* line = dynamic_cast<const LineEntity*>(entity.get());
-                    if (line) {
-                        vertices.push_back({ { line->x1, line->y1 }, { 1.0f, 0.0f, 0.0f } });
-                        vertices.push_back({ { line->x2, line->y2 }, { 1.0f, 0.0f, 0.0f } });
-                    }
-                } else if (type == "Circle") {
-                    const CircleEntity* circle = dynamic_cast<const CircleEntity*>(entity.get());
-                    if (circle) {
-                        constexpr int SEGMENTS = 64;
-                        for (int i = 0; i < SEGMENTS; ++i) {
-                            float angle1 = (float)i / SEGMENTS * 2.0f * 3.1415926f;
-                            float angle2 = (float)(i + 1) / SEGMENTS * 2.0f * 3.1415926f;
-                            float x1 = circle->cx + cos(angle1) * circle->radius;
-                            float y1 = circle->cy + sin(angle1) * circle->radius;
-                            float x2 = circle->cx + cos(angle2) * circle->radius;
-                            float y2 = circle->cy + sin(angle2) * circle->radius;
-                            vertices.push_back({ { x1, y1 }, { 0.0f, 1.0f, 0.0f } });
-                            vertices.push_back({ { x2, y2 }, { 0.0f, 1.0f, 0.0f } });
-                        }
-                    }
-                }
-            }
-        }
-
-        size_t buffer_size = vertices.size() * sizeof(Vertex);
-        createVertexBuffer(buffer_size);
+    uploader.BeginFrame(frame_index);
+    updateSceneGeometry(doc);
+    if (!dirty_layers.empty() || doc.GetSelectionRevision() != selection_revision) selectionDirty = true;
+    if (selectionDirty) updateSelectionOverlay(doc);
+    uploader.Flush(cmd);
 
-        void* data;
-        check_vk_result(vkMapMemory(device, vertexMemoryLayers, 0, buffer_size, 0, &data));
-        memcpy(data, vertices.data(), buffer_size);
-        vkUnmapMemory(device, vertexMemoryLayers);
+    vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
 
-        sceneDirty = false;
-    }
+    VkViewport viewport = {};
+    viewport.width = (float)swapchain_extent.width;
+    viewport.height = (float)swapchain_extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
 
-    vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    VkRect2D scissor = {};
+    scissor.extent = swapchain_extent;
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-    VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBufferLayers, offsets);
-    vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &viewProjMatrix);
-    vkCmdDraw(cmd, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
+    recordSceneDraws(cmd, doc);
+    recordSelectionOverlay(cmd);
 
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+    if (!headless) ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
     vkCmdEndRenderPass(cmd);
     check_vk_result(vkEndCommandBuffer(cmd));
 
     VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
+    submit_info.waitSemaphoreCount = headless ? 0 : 1;
     submit_info.pWaitSemaphores = &image_acquired_semaphores[frame_index];
     submit_info.pWaitDstStageMask = &wait_stage;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &cmd;
-    submit_info.signalSemaphoreCount = 1;
+    submit_info.signalSemaphoreCount = headless ? 0 : 1;
     submit_info.pSignalSemaphores = &render_complete_semaphores[frame_index];
     check_vk_result(vkQueueSubmit(queue, 1, &submit_info, frame_fences[frame_index]));
+    last_image_index = image_index;
+
+    if (headless) {
+        frame_index = (frame_index + 1) % FRAME_COUNT;
+        drawnRevision = doc.GetRevision();
+        selectionDirty = false;
+        cameraDirty = false;
+        redrawRequested = false;
+        return;
+    }
 
     VkPresentInfoKHR present_info = {};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -311,19 +452,59 @@ void Renderer::RenderFrame(const CADDocument& doc) {
     }
 
     frame_index = (frame_index + 1) % FRAME_COUNT;
+
+    // Everything requested so far is now on screen
+    drawnRevision = doc.GetRevision();
+    selectionDirty = false;
+    cameraDirty = false;
+    redrawRequested = false;
+}
+
+bool Renderer::NeedsRedraw(const CADDocument& doc) const {
+    return sceneDirty || selectionDirty || cameraDirty || redrawRequested ||
+           doc.GetRevision() != drawnRevision;
 }
 
 
 void Renderer::Cleanup() {
     vkDeviceWaitIdle(device);
 
+    for (auto& entry : layer_gpu) {
+        uploader.Release(entry.second.vertexBuffer);
+        uploader.Release(entry.second.circleBuffer);
+        uploader.Release(entry.second.trackBuffer);
+    }
+    layer_gpu.clear();
+    uploader.Release(selectionTrackBuffer);
+    uploader.Release(selectionCircleBuffer);
+    uploader.Destroy();
+
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipeline(device, circle_pipeline, nullptr);
+    vkDestroyPipeline(device, track_pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    pipeline_cache.Save();
+    pipeline_cache.Destroy();
+
     for (auto framebuffer : framebuffers)
         vkDestroyFramebuffer(device, framebuffer, nullptr);
-    for (auto view : swapchain_image_views)
-        vkDestroyImageView(device, view, nullptr);
+
+    // Headless mode enables no surface or swapchain extension, so it must
+    // not call into them; its images and their memory are ours to free
+    if (!headless) {
+        for (auto view : swapchain_image_views)
+            vkDestroyImageView(device, view, nullptr);
+        vkDestroySwapchainKHR(device, swapchain, nullptr);
+    } else {
+        for (size_t i = 0; i < offscreen_memory.size(); i++) {
+            vkDestroyImageView(device, swapchain_image_views[i], nullptr);
+            vkDestroyImage(device, swapchain_images[i], nullptr);
+            vkFreeMemory(device, offscreen_memory[i], nullptr);
+        }
+        offscreen_memory.clear();
+    }
 
     vkDestroyRenderPass(device, render_pass, nullptr);
-    vkDestroySwapchainKHR(device, swapchain, nullptr);
     vkDestroyCommandPool(device, command_pool, nullptr);
 
     for (int i = 0; i < FRAME_COUNT; i++) {
@@ -333,85 +514,372 @@ void Renderer::Cleanup() {
     }
 
     vkDestroyDevice(device, nullptr);
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (!headless) vkDestroySurfaceKHR(instance, surface, nullptr);
     vkDestroyInstance(instance, nullptr);
 }
 
-void Renderer::createVertexBuffer(size_t size) {
-    // Clean up previous buffer if it exists
-    if (vertexBufferLayers != VK_NULL_HANDLE) {
-        vkDestroyBuffer(device, vertexBufferLayers, nullptr);
-        vertexBufferLayers = VK_NULL_HANDLE;
+void Renderer::updateSceneGeometry(const CADDocument& doc) {
+    const auto& layers = doc.GetLayers();
+
+    // Only layers whose geometry changed are rebuilt; visibility is ignored here
+    dirty_layers.clear();
+    dirty_geometry.clear();
+    for (uint32_t i = 0; i < layers.size(); ++i) {
+        LayerGpu& gpu = layer_gpu[layers[i].id];
+        if (gpu.built && gpu.revision == layers[i].revision && !sceneDirty) continue;
+
+        // In-place edits since the last upload are patched range by range
+        if (gpu.built && !sceneDirty && layers[i].structureRevision <= gpu.revision && patchLayer(layers[i], gpu)) {
+            selectionDirty = true;
+            continue;
+        }
+        dirty_layers.push_back(i);
+        dirty_geometry.push_back(&gpu.geometry);
     }
-    if (vertexMemoryLayers != VK_NULL_HANDLE) {
-        vkFreeMemory(device, vertexMemoryLayers, nullptr);
-        vertexMemoryLayers = VK_NULL_HANDLE;
+
+    // Drop the GPU copies of layers that left the document
+    if (layer_gpu.size() > layers.size()) {
+        for (auto it = layer_gpu.begin(); it != layer_gpu.end();) {
+            bool present = std::any_of(layers.begin(), layers.end(),
+                [&](const Layer& layer) { return layer.id == it->first; });
+            if (present) {
+                ++it;
+            } else {
+                uploader.Release(it->second.vertexBuffer);
+                uploader.Release(it->second.circleBuffer);
+                uploader.Release(it->second.trackBuffer);
+                it = layer_gpu.erase(it);
+            }
+        }
     }
 
-    // Create the buffer
-    VkBufferCreateInfo buffer_info = {};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.size = size;
-    buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    sceneDirty = false;
+    if (dirty_layers.empty()) return;
 
-    check_vk_result(vkCreateBuffer(device, &buffer_info, nullptr, &vertexBufferLayers));
+    tessellator.Build(doc, dirty_layers, dirty_geometry, tessellation_pool);
 
-    // Get memory requirements
-    VkMemoryRequirements mem_requirements;
-    vkGetBufferMemoryRequirements(device, vertexBufferLayers, &mem_requirements);
+    for (uint32_t i : dirty_layers) {
+        LayerGpu& gpu = layer_gpu[layers[i].id];
+        const LayerGeometry& geometry = gpu.geometry;
 
-    // Allocate memory
-    VkMemoryAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_requirements.size;
+        VkDeviceSize vertex_size = geometry.vertices.size() * sizeof(Vertex);
+        VkDeviceSize circle_size = geometry.circles.size() * sizeof(CircleInstance);
+        VkDeviceSize track_size = geometry.tracks.size() * sizeof(TrackInstance);
+        uploader.Reserve(gpu.vertexBuffer, vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        uploader.Reserve(gpu.circleBuffer, circle_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        uploader.Reserve(gpu.trackBuffer, track_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        uploader.Upload(gpu.vertexBuffer, 0, geometry.vertices.data(), vertex_size);
+        uploader.Upload(gpu.circleBuffer, 0, geometry.circles.data(), circle_size);
+        uploader.Upload(gpu.trackBuffer, 0, geometry.tracks.data(), track_size);
+
+        gpu.revision = layers[i].revision;
+        gpu.built = true;
+        gpu.lodPixelSize = -1.0f;
+    }
+}
+
+void Renderer::recordSceneDraws(VkCommandBuffer cmd, const CADDocument& doc) {
+    CameraPushConstants camera = {};
+    camera.viewProj = viewProjMatrix;
+    camera.pixelSize = pixelSize();
+    std::copy(std::begin(palette), std::end(palette), camera.palette);
+    vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(camera), &camera);
+
+    VkPipeline bound = VK_NULL_HANDLE;
+    auto bind = [&](VkPipeline p) {
+        if (bound == p) return;
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p);
+        bound = p;
+    };
+
+    // World-space rectangle seen through the viewport, padded for anti-aliased edges
+    glm::mat4 inverse_view_proj = glm::inverse(viewProjMatrix);
+    float view_min_x = FLT_MAX, view_min_y = FLT_MAX, view_max_x = -FLT_MAX, view_max_y = -FLT_MAX;
+    for (float nx : { -1.0f, 1.0f }) {
+        for (float ny : { -1.0f, 1.0f }) {
+            glm::vec4 corner = inverse_view_proj * glm::vec4(nx, ny, 0.0f, 1.0f);
+            view_min_x = std::min(view_min_x, corner.x);
+            view_min_y = std::min(view_min_y, corner.y);
+            view_max_x = std::max(view_max_x, corner.x);
+            view_max_y = std::max(view_max_y, corner.y);
+        }
+    }
+    float pad = 4.0f * camera.pixelSize;
+    auto in_view = [&](const GeometryChunk& c) {
+        return c.maxX >= view_min_x - pad && c.minX <= view_max_x + pad &&
+               c.maxY >= view_min_y - pad && c.minY <= view_max_y + pad;
+    };
+
+    // Layers draw in document order; hidden ones are simply not recorded
+    VkDeviceSize offsets[] = { 0 };
+    for (const Layer& layer : doc.GetLayers()) {
+        if (!layer.visible) continue;
+        auto found = layer_gpu.find(layer.id);
+        if (found == layer_gpu.end()) continue;
+        LayerGpu& gpu = found->second;
+        const auto& chunks = gpu.geometry.chunks;
+
+        // Copper first, so hairlines and pad outlines stay visible on top
+        if (!gpu.geometry.tracks.empty()) {
+            bind(track_pipeline);
+            vkCmdBindVertexBuffers(cmd, 0, 1, &gpu.trackBuffer.buffer, offsets);
+
+            // Tracks are absolute, so neighbouring visible chunks share a draw
+            uint32_t run_first = 0, run_count = 0;
+            for (const GeometryChunk& chunk : chunks) {
+                if (chunk.trackCount == 0) continue;
+                if (in_view(chunk) && run_count > 0 && run_first + run_count == chunk.firstTrack) {
+                    run_count += chunk.trackCount;
+                    continue;
+                }
+                if (run_count > 0) vkCmdDraw(cmd, 6, run_count, 0, run_first);
+                run_count = 0;
+                if (in_view(chunk)) {
+                    run_first = chunk.firstTrack;
+                    run_count = chunk.trackCount;
+                }
+            }
+            if (run_count > 0) vkCmdDraw(cmd, 6, run_count, 0, run_first);
+        }
+
+        if (!gpu.geometry.vertices.empty()) {
+            bind(pipeline);
+            vkCmdBindVertexBuffers(cmd, 0, 1, &gpu.vertexBuffer.buffer, offsets);
+
+            // Vertices are relative to their chunk, so each visible chunk is its own draw
+            // and only the chunk box is pushed between them
+            const uint32_t chunk_offset = offsetof(CameraPushConstants, chunkOrigin);
+            for (const GeometryChunk& chunk : chunks) {
+                if (chunk.vertexCount == 0 || !in_view(chunk)) continue;
+
+                float box[4] = { chunk.minX, chunk.minY, chunk.maxX - chunk.minX, chunk.maxY - chunk.minY };
+                vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, chunk_offset, sizeof(box), box);
+                vkCmdDraw(cmd, chunk.vertexCount, 1, chunk.firstVertex, 0);
+            }
+        }
+
+        if (!gpu.geometry.circles.empty()) {
+            updateCircleLods(gpu, camera.pixelSize);
+            bind(circle_pipeline);
+            vkCmdBindVertexBuffers(cmd, 0, 1, &gpu.circleBuffer.buffer, offsets);
+
+            // One draw per non-empty LOD bucket of each visible chunk
+            for (size_t lod = 0; lod < CIRCLE_LOD_COUNT; ++lod) {
+                camera.circleSegments = CIRCLE_LODS[lod].segments;
+                uint32_t vertex_count = camera.circleSegments == 0 ? 6 : camera.circleSegments * 6;
+                bool pushed = false;
+
+                for (size_t c = 0; c < chunks.size(); ++c) {
+                    const uint32_t* split = &gpu.lodSplits[c * (CIRCLE_LOD_COUNT + 1)];
+                    uint32_t count = split[lod + 1] - split[lod];
+                    if (count == 0 || !in_view(chunks[c])) continue;
+
+                    if (!pushed) {
+                        vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(camera), &camera);
+                        pushed = true;
+                    }
+                    vkCmdDraw(cmd, vertex_count, count, 0, split[lod]);
+                }
+            }
+        }
+    }
+}
+
+bool Renderer::patchLayer(const Layer& layer, LayerGpu& gpu) {
+    // Edits are in revision order, so the ones not yet uploaded are a suffix
+    auto first = std::upper_bound(layer.edits.begin(), layer.edits.end(), gpu.revision,
+        [](uint64_t r, const Layer::Edit& e) { return r < e.revision; });
+
+    geometry_patch.Clear();
+    for (auto it = first; it != layer.edits.end(); ++it) {
+        if (!Tessellator::Patch(layer, gpu.geometry, it->kind, it->index, geometry_patch)) return false;
+    }
+
+    // Neighbouring and overlapping ranges become one copy each
+    auto upload = [&](std::vector<GeometryPatch::Range>& ranges, GpuBuffer& buffer, const void* data, size_t stride) {
+        std::sort(ranges.begin(), ranges.end(),
+            [](const GeometryPatch::Range& a, const GeometryPatch::Range& b) { return a.first < b.first; });
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t r = 0; r < ranges.size();) {
+            uint32_t begin = ranges[r].first, end = begin + ranges[r].count;
+            for (++r; r < ranges.size() && ranges[r].first <= end; ++r)
+                end = std::max(end, ranges[r].first + ranges[r].count);
+            uploader.Upload(buffer, (VkDeviceSize)begin * stride, bytes + (size_t)begin * stride,
+                            (VkDeviceSize)(end - begin) * stride);
+        }
+    };
+    upload(geometry_patch.vertices, gpu.vertexBuffer, gpu.geometry.vertices.data(), sizeof(Vertex));
+    upload(geometry_patch.circles, gpu.circleBuffer, gpu.geometry.circles.data(), sizeof(CircleInstance));
+    upload(geometry_patch.tracks, gpu.trackBuffer, gpu.geometry.tracks.data(), sizeof(TrackInstance));
+
+    gpu.revision = layer.revision;
+    return true;
+}
 
-    VkPhysicalDeviceMemoryProperties mem_properties;
-    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+void Renderer::SetPreviewTransform(const glm::mat4& transform) {
+    preview_transform = transform;
+    preview_active = true;
+    redrawRequested = true;
+}
 
-    uint32_t memory_type_index = (uint32_t)-1;
-    for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-        if ((mem_requirements.memoryTypeBits & (1 << i)) &&
-            (mem_properties.memoryTypes[i].propertyFlags &
-             (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))) {
-            memory_type_index = i;
+void Renderer::ClearPreviewTransform() {
+    if (!preview_active) return;
+    preview_active = false;
+    redrawRequested = true;
+}
+
+void Renderer::updateSelectionOverlay(const CADDocument& doc) {
+    selection_tracks.clear();
+    selection_circles.clear();
+
+    auto add = [&](EntityId id, uint32_t color) {
+        EntityRef ref;
+        if (!doc.Resolve(id, ref)) return;
+        const Layer* layer = doc.FindLayer(ref.layerId);
+        if (!layer || !layer->visible) return;
+
+        switch (ref.kind) {
+        case EntityKind::Line: {
+            const LineArrays& l = layer->lines;
+            if (ref.index >= l.Size()) return;
+            selection_tracks.push_back({ { l.x1[ref.index], l.y1[ref.index] },
+                                         { l.x2[ref.index], l.y2[ref.index] }, 0.0f, color });
+            break;
+        }
+        case EntityKind::Circle: {
+            const CircleArrays& c = layer->circles;
+            if (ref.index >= c.Size()) return;
+            selection_circles.push_back({ { c.cx[ref.index], c.cy[ref.index] }, c.r[ref.index], color });
+            break;
+        }
+        case EntityKind::Track: {
+            const TrackArrays& t = layer->tracks;
+            if (ref.index >= t.Size()) return;
+            selection_tracks.push_back({ { t.x1[ref.index], t.y1[ref.index] },
+                                         { t.x2[ref.index], t.y2[ref.index] }, 0.5f * t.width[ref.index], color });
             break;
         }
+        }
+    };
+
+    for (EntityId id : doc.GetSelection()) add(id, PALETTE_SELECTION);
+    selection_track_count = (uint32_t)selection_tracks.size();
+    selection_circle_count = (uint32_t)selection_circles.size();
+    add(doc.GetHover(), PALETTE_HOVER);
+
+    VkDeviceSize track_size = selection_tracks.size() * sizeof(TrackInstance);
+    VkDeviceSize circle_size = selection_circles.size() * sizeof(CircleInstance);
+    uploader.Reserve(selectionTrackBuffer, track_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    uploader.Reserve(selectionCircleBuffer, circle_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    uploader.Upload(selectionTrackBuffer, 0, selection_tracks.data(), track_size);
+    uploader.Upload(selectionCircleBuffer, 0, selection_circles.data(), circle_size);
+
+    selection_revision = doc.GetSelectionRevision();
+}
+
+void Renderer::recordSelectionOverlay(VkCommandBuffer cmd) {
+    if (selection_tracks.empty() && selection_circles.empty()) return;
+
+    // Scene draws leave the camera pushed; only the circle LOD needs resetting
+    VkDeviceSize offsets[] = { 0 };
+    if (!selection_tracks.empty()) {
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, track_pipeline);
+        vkCmdBindVertexBuffers(cmd, 0, 1, &selectionTrackBuffer.buffer, offsets);
+        vkCmdDraw(cmd, 6, (uint32_t)selection_tracks.size(), 0, 0);
+    }
+    if (!selection_circles.empty()) {
+        uint32_t quad = 0;
+        vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
+                           offsetof(CameraPushConstants, circleSegments), sizeof(quad), &quad);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, circle_pipeline);
+        vkCmdBindVertexBuffers(cmd, 0, 1, &selectionCircleBuffer.buffer, offsets);
+        vkCmdDraw(cmd, 6, (uint32_t)selection_circles.size(), 0, 0);
     }
 
-    if (memory_type_index == (uint32_t)-1) {
-        throw std::runtime_error("Failed to find suitable memory type for vertex buffer!");
+    // Drag preview: the selected entities again, moved by the view transform
+    // alone; it is the last scene draw, so the camera is not restored
+    if (preview_active && (selection_track_count || selection_circle_count)) {
+        glm::mat4 moved = viewProjMatrix * preview_transform;
+        vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(moved), &moved);
+        if (selection_track_count) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, track_pipeline);
+            vkCmdBindVertexBuffers(cmd, 0, 1, &selectionTrackBuffer.buffer, offsets);
+            vkCmdDraw(cmd, 6, selection_track_count, 0, 0);
+        }
+        if (selection_circle_count) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, circle_pipeline);
+            vkCmdBindVertexBuffers(cmd, 0, 1, &selectionCircleBuffer.buffer, offsets);
+            vkCmdDraw(cmd, 6, selection_circle_count, 0, 0);
+        }
     }
+}
 
-    alloc_info.memoryTypeIndex = memory_type_index;
+void Renderer::updateCircleLods(LayerGpu& gpu, float pixel) {
+    if (pixel == gpu.lodPixelSize) return;
+    gpu.lodPixelSize = pixel;
+
+    // Circles are sorted by radius inside each chunk, so each bucket boundary is a binary search
+    const auto& circles = gpu.geometry.circles;
+    const auto& chunks = gpu.geometry.chunks;
+    gpu.lodSplits.resize(chunks.size() * (CIRCLE_LOD_COUNT + 1));
+
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        uint32_t* split = &gpu.lodSplits[c * (CIRCLE_LOD_COUNT + 1)];
+        auto begin = circles.begin() + chunks[c].firstCircle;
+        auto end = begin + chunks[c].circleCount;
+
+        split[0] = chunks[c].firstCircle;
+        for (size_t lod = 0; lod < CIRCLE_LOD_COUNT; ++lod) {
+            float max_radius = CIRCLE_LODS[lod].maxScreenRadius * pixel;
+            auto it = lod + 1 == CIRCLE_LOD_COUNT ? end :
+                std::lower_bound(begin, end, max_radius,
+                    [](const CircleInstance& circle, float r) { return circle.radius < r; });
+            split[lod + 1] = (uint32_t)(it - circles.begin());
+            begin = it;
+        }
+    }
+}
 
-    check_vk_result(vkAllocateMemory(device, &alloc_info, nullptr, &vertexMemoryLayers));
-    check_vk_result(vkBindBufferMemory(device, vertexBufferLayers, vertexMemoryLayers, 0));
+float Renderer::pixelSize() const {
+    // The projection spans 2 * zoom world units over the height, and as
+    // many per pixel across the width
+    float pixels = (float)swapchain_extent.height;
+    return pixels > 0.0f ? 2.0f * camera_zoom / pixels : 0.0f;
 }
 
 void Renderer::UpdateCamera(float zoom, glm::vec2 pan) {
-    glm::mat4 proj = glm::ortho(-zoom, zoom, -zoom, zoom, -1.0f, 1.0f);
-    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(pan, 0.0f));
+    camera_zoom = zoom;
+    camera_pan = pan;
+    updateViewProj();
+}
+
+void Renderer::updateViewProj() {
+    // Square pixels: the horizontal half-span follows the aspect ratio
+    float aspect = swapchain_extent.height > 0 ? (float)swapchain_extent.width / swapchain_extent.height : 1.0f;
+    glm::mat4 proj = glm::ortho(-camera_zoom * aspect, camera_zoom * aspect, -camera_zoom, camera_zoom, -1.0f, 1.0f);
+    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(camera_pan, 0.0f));
     viewProjMatrix = proj * view;
     cameraDirty = true;
 }
 
-VkShaderModule Renderer::loadShaderModule(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::ate | std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open shader file: " + filepath);
-    }
+glm::vec2 Renderer::ScreenToWorld(float x, float y) const {
+    if (swapchain_extent.width == 0 || swapchain_extent.height == 0) return glm::vec2(0.0f);
+    // Vulkan NDC has +y pointing down, same as framebuffer rows
+    glm::vec4 ndc(2.0f * x / swapchain_extent.width - 1.0f, 2.0f * y / swapchain_extent.height - 1.0f, 0.0f, 1.0f);
+    glm::vec4 world = glm::inverse(viewProjMatrix) * ndc;
+    return glm::vec2(world.x, world.y);
+}
 
-    size_t file_size = (size_t)file.tellg();
-    std::vector<char> buffer(file_size);
-    file.seekg(0);
-    file.read(buffer.data(), file_size);
-    file.close();
+glm::vec2 Renderer::WorldToScreen(float x, float y) const {
+    glm::vec4 ndc = viewProjMatrix * glm::vec4(x, y, 0.0f, 1.0f);
+    return glm::vec2((ndc.x + 1.0f) * 0.5f * swapchain_extent.width, (ndc.y + 1.0f) * 0.5f * swapchain_extent.height);
+}
 
+VkShaderModule Renderer::createShaderModule(const uint32_t* code, size_t codeSize) {
     VkShaderModuleCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    create_info.codeSize = buffer.size();
-    create_info.pCode = reinterpret_cast<const uint32_t*>(buffer.data());
+    create_info.codeSize = codeSize;
+    create_info.pCode = code;
 
     VkShaderModule shader_module;
     check_vk_result(vkCreateShaderModule(device, &create_info, nullptr, &shader_module));
@@ -426,8 +894,9 @@ void Renderer::createInstance() {
     app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     app_info.apiVersion = VK_API_VERSION_1_0;
 
+    // Headless runs never touch GLFW, so no surface extensions are requested
     uint32_t glfw_ext_count = 0;
-    const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+    const char** glfw_extensions = headless ? nullptr : glfwGetRequiredInstanceExtensions(&glfw_ext_count);
 
     VkInstanceCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -483,9 +952,13 @@ void Renderer::createSwapchain(GLFWwindow* window) {
     swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchain_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
     swapchain_info.clipped = VK_TRUE;
-    swapchain_info.oldSwapchain = VK_NULL_HANDLE;
+    // Handing over the old swapchain lets the driver recycle its resources on resize
+    VkSwapchainKHR old_swapchain = swapchain;
+    swapchain_info.oldSwapchain = old_swapchain;
 
     check_vk_result(vkCreateSwapchainKHR(device, &swapchain_info, nullptr, &swapchain));
+    if (old_swapchain != VK_NULL_HANDLE)
+        vkDestroySwapchainKHR(device, old_swapchain, nullptr);
 
     uint32_t image_count = 0;
     vkGetSwapchainImagesKHR(device, swapchain, &image_count, nullptr);
@@ -509,6 +982,144 @@ void Renderer::createSwapchain(GLFWwindow* window) {
     }
 }
 
+void Renderer::createOffscreenTargets(uint32_t width, uint32_t height) {
+    swapchain_image_format = VK_FORMAT_R8G8B8A8_UNORM;
+    swapchain_extent = { width, height };
+
+    swapchain_images.resize(FRAME_COUNT);
+    swapchain_image_views.resize(FRAME_COUNT);
+    offscreen_memory.resize(FRAME_COUNT);
+
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = swapchain_image_format;
+        image_info.extent = { width, height, 1 };
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        check_vk_result(vkCreateImage(device, &image_info, nullptr, &swapchain_images[i]));
+
+        VkMemoryRequirements mem_requirements;
+        vkGetImageMemoryRequirements(device, swapchain_images[i], &mem_requirements);
+
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = mem_requirements.size;
+        alloc_info.memoryTypeIndex = uploader.FindMemoryType(mem_requirements.memoryTypeBits,
+                                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        check_vk_result(vkAllocateMemory(device, &alloc_info, nullptr, &offscreen_memory[i]));
+        check_vk_result(vkBindImageMemory(device, swapchain_images[i], offscreen_memory[i], 0));
+
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = swapchain_images[i];
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = swapchain_image_format;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+
+        check_vk_result(vkCreateImageView(device, &view_info, nullptr, &swapchain_image_views[i]));
+    }
+}
+
+void Renderer::ReadbackFrame(std::vector<uint8_t>& rgba) {
+    if (!headless) throw std::runtime_error("ReadbackFrame requires a headless renderer");
+
+    vkQueueWaitIdle(queue);
+
+    VkDeviceSize size = (VkDeviceSize)swapchain_extent.width * swapchain_extent.height * 4;
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer readback_buffer;
+    check_vk_result(vkCreateBuffer(device, &buffer_info, nullptr, &readback_buffer));
+
+    VkMemoryRequirements mem_requirements;
+    vkGetBufferMemoryRequirements(device, readback_buffer, &mem_requirements);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_requirements.size;
+    alloc_info.memoryTypeIndex = uploader.FindMemoryType(mem_requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VkDeviceMemory readback_memory;
+    check_vk_result(vkAllocateMemory(device, &alloc_info, nullptr, &readback_memory));
+    check_vk_result(vkBindBufferMemory(device, readback_buffer, readback_memory, 0));
+
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = command_pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+
+    VkCommandBuffer cmd;
+    check_vk_result(vkAllocateCommandBuffers(device, &cmd_info, &cmd));
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    check_vk_result(vkBeginCommandBuffer(cmd, &begin_info));
+
+    // The render pass left the image in TRANSFER_SRC; make its color writes visible to the copy
+    VkImageMemoryBarrier to_copy = {};
+    to_copy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    to_copy.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    to_copy.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    to_copy.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    to_copy.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    to_copy.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    to_copy.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    to_copy.image = swapchain_images[last_image_index];
+    to_copy.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &to_copy);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { swapchain_extent.width, swapchain_extent.height, 1 };
+    vkCmdCopyImageToBuffer(cmd, swapchain_images[last_image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           readback_buffer, 1, &region);
+
+    VkMemoryBarrier to_host = {};
+    to_host.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    to_host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    to_host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &to_host, 0, nullptr, 0, nullptr);
+    check_vk_result(vkEndCommandBuffer(cmd));
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd;
+    check_vk_result(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE));
+    vkQueueWaitIdle(queue);
+
+    void* mapped = nullptr;
+    check_vk_result(vkMapMemory(device, readback_memory, 0, size, 0, &mapped));
+    rgba.resize((size_t)size);
+    memcpy(rgba.data(), mapped, (size_t)size);
+    vkUnmapMemory(device, readback_memory);
+
+    vkFreeCommandBuffers(device, command_pool, 1, &cmd);
+    vkDestroyBuffer(device, readback_buffer, nullptr);
+    vkFreeMemory(device, readback_memory, nullptr);
+}
+
 void Renderer::createRenderPass() {
     VkAttachmentDescription color_attachment = {};
     color_attachment.format = swapchain_image_format;
@@ -518,7 +1129,7 @@ void Renderer::createRenderPass() {
     color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    color_attachment.finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference color_attachment_ref = {};
     color_attachment_ref.attachment = 0;
@@ -604,6 +1215,8 @@ void Renderer::createSyncObjects() {
 void Renderer::pickPhysicalDevice() {
     uint32_t gpu_count = 0;
     vkEnumeratePhysicalDevices(instance, &gpu_count, nullptr);
+    if (gpu_count == 0)
+        throw std::runtime_error("No Vulkan device found (for CPU-only runs install lavapipe)");
     std::vector<VkPhysicalDevice> gpus(gpu_count);
     vkEnumeratePhysicalDevices(instance, &gpu_count, gpus.data());
     physical_device = gpus[0];
@@ -615,8 +1228,9 @@ void Renderer::pickPhysicalDevice() {
 
     queue_family = (uint32_t)-1;
     for (uint32_t i = 0; i < queue_family_count; i++) {
-        VkBool32 present_support = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, &present_support);
+        VkBool32 present_support = headless;
+        if (!headless)
+            vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, &present_support);
         if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && present_support) {
             queue_family = i;
             break;
@@ -642,7 +1256,7 @@ void Renderer::createDevice() {
     device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     device_info.queueCreateInfoCount = 1;
     device_info.pQueueCreateInfos = &queue_info;
-    device_info.enabledExtensionCount = 1;
+    device_info.enabledExtensionCount = headless ? 0 : 1;
     device_info.ppEnabledExtensionNames = device_extensions;
 
     check_vk_result(vkCreateDevice(physical_device, &device_info, nullptr, &device));
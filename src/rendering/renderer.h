@@ -7,25 +7,39 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
+#include <unordered_map>
 #include <iostream>
 #include <glm/glm.hpp>
 
 #include "core/cad_document.h"
 #include "core/entity/line_entity.h"
 #include "core/entity/circle_entity.h"
+#include "rendering/vertex.h"
+#include "rendering/gpu_buffer.h"
+#include "rendering/pipeline_cache.h"
+#include "rendering/tessellator.h"
+#include "utils/thread_pool.h"
 
+class CADDocument; // Forward declare
 
-// Vertex structure for rendering
-struct Vertex {
-    float pos[2];
-    float color[3];
+// Push constants shared by the scene pipelines (layout mirrored in the shaders)
+struct CameraPushConstants {
+    glm::mat4 viewProj;
+    float pixelSize;            // World units per screen pixel
+    uint32_t circleSegments;    // Circle LOD of the current draw (0 = quad)
+    float chunkOrigin[2];       // Box that line vertices are quantized against
+    float chunkExtent[2];
+    uint32_t palette[PALETTE_SIZE];  // RGBA8, indexed by PaletteIndex
 };
-
-class CADDocument; // Forward declare
+static_assert(sizeof(CameraPushConstants) <= 128, "Vulkan only guarantees 128 bytes of push constants");
 
 class Renderer {
 public:
     void Init(GLFWwindow* window);
+    // No window or surface: frames go to offscreen images that can be read
+    // back. Works on CPU implementations such as lavapipe.
+    void InitHeadless(uint32_t width, uint32_t height);
     void RenderFrame(const CADDocument& doc);
     void Cleanup();
     void createPipeline();
@@ -36,40 +50,79 @@ public:
     VkQueue GetQueue() const { return queue; }
     uint32_t GetQueueFamily() const { return queue_family; }
     VkRenderPass GetRenderPass() const { return render_pass; }
-    VkShaderModule loadShaderModule(const std::string& filepath);
+    // Called with the new render pass when a swapchain recreation had to
+    // replace it (surface format change), so UI backends built against the
+    // old one can follow. The device is idle at that point.
+    void SetRenderPassChangedCallback(std::function<void(VkRenderPass)> callback) { renderPassChanged = std::move(callback); }
+    VkExtent2D GetExtent() const { return swapchain_extent; }
+    bool IsHeadless() const { return headless; }
+    VkShaderModule createShaderModule(const uint32_t* code, size_t codeSize);
     void UpdateCamera(float zoom, glm::vec2 pan);
-
-    // VkBuffer vertex_buffer{};
-    // VkDeviceMemory vertex_buffer_memory{};
-    VkBuffer vertexBufferLayers = VK_NULL_HANDLE;
-    VkDeviceMemory vertexMemoryLayers = VK_NULL_HANDLE;
-
-    VkBuffer vertexBufferSelection;     // Dynamic selection layer
-    VkDeviceMemory vertexMemorySelection;
-
-    std::vector<Vertex> vertices;
+    // Framebuffer pixel (origin top left) to document coordinates under the current camera
+    glm::vec2 ScreenToWorld(float x, float y) const;
+    glm::vec2 WorldToScreen(float x, float y) const;
+    // World units covered by one pixel, for turning pixel tolerances into document units
+    float WorldPerPixel() const { return pixelSize(); }
+
+    // True when the next RenderFrame would show something new
+    bool NeedsRedraw(const CADDocument& doc) const;
+    // Forces the next frame to be drawn (window exposed, resized, ...)
+    void RequestRedraw() { redrawRequested = true; }
+
+    // Draws the selection a second time under `transform` (world space),
+    // e.g. while dragging it; the document is only edited on commit
+    void SetPreviewTransform(const glm::mat4& transform);
+    void ClearPreviewTransform();
+
+    // Headless only: waits for the last frame and copies it out as tightly
+    // packed RGBA8 rows, top row first
+    void ReadbackFrame(std::vector<uint8_t>& rgba);
 
 private:
     // Dirty flags for efficient redraws
     bool sceneDirty = true;      // Set true if geometry changes
     bool selectionDirty = true;  // Set true if selection changes
     bool cameraDirty = true;     // Set true if zoom/pan changes
+    bool redrawRequested = true;
+    uint64_t drawnRevision = UINT64_MAX;  // Document revision on screen
     GLFWwindow* window = nullptr;
+    bool headless = false;
+    std::function<void(VkRenderPass)> renderPassChanged;
 
     void createInstance();
     void pickPhysicalDevice();
     void createDevice();
     void createSwapchain(GLFWwindow* window);
+    void createOffscreenTargets(uint32_t width, uint32_t height);
     void createRenderPass();
     void createFramebuffers();
     void createCommandPool();
     void createCommandBuffers();
-    void createSelectionVertexBuffer(size_t size);
     void createSyncObjects();
 
     void check_vk_result(VkResult err);
-    void createVertexBuffer(size_t size);
-    void createLayerVertexBuffer(size_t size);
+    void updateSceneGeometry(const CADDocument& doc);
+    void recordSceneDraws(VkCommandBuffer cmd, const CADDocument& doc);
+    void updateSelectionOverlay(const CADDocument& doc);
+    void recordSelectionOverlay(VkCommandBuffer cmd);
+    float pixelSize() const;
+    void updateViewProj();
+
+    // Everything that differs between the scene pipelines
+    struct ShaderCode {
+        const uint32_t* code = nullptr;
+        size_t size = 0;            // In bytes
+    };
+    struct PipelineDesc {
+        ShaderCode vertShader;
+        ShaderCode fragShader;
+        VkVertexInputBindingDescription binding{};
+        const VkVertexInputAttributeDescription* attributes = nullptr;
+        uint32_t attributeCount = 0;
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+        bool blend = false;
+    };
+    VkPipeline buildPipeline(const PipelineDesc& desc);
     void markAllDirty();
 
     VkInstance instance{};
@@ -96,10 +149,60 @@ private:
     std::vector<VkFence> frame_fences;
 
     uint32_t frame_index{0};
+    uint32_t last_image_index{0};   // Image written by the last submitted frame
 
-    VkPipelineLayout pipeline_layout{};
-    VkPipeline pipeline{};
+    // Headless: the "swapchain" images are plain images owned by the renderer
+    std::vector<VkDeviceMemory> offscreen_memory;
 
+    VkPipelineLayout pipeline_layout{};
+    VkPipeline pipeline{};          // Line list
+    VkPipeline circle_pipeline{};   // Instanced circles
+    VkPipeline track_pipeline{};    // Instanced capsules
+    float camera_zoom = 1.0f;      // Half the view height, in world units
+    glm::vec2 camera_pan{ 0.0f };
+    uint32_t palette[PALETTE_SIZE];
+
+
+    // GPU copy of one document layer. Each layer owns its buffers and
+    // draw calls, so hiding or reordering layers never touches geometry.
+    struct LayerGpu {
+        uint64_t revision = 0;
+        bool built = false;
+        LayerGeometry geometry;         // Source of the last upload
+        GpuBuffer vertexBuffer;         // Device-local, grows but is never recreated per edit
+        GpuBuffer circleBuffer;
+        GpuBuffer trackBuffer;
+
+        // Per chunk: first circle of each LOD bucket, plus the end; recomputed on zoom
+        std::vector<uint32_t> lodSplits;
+        float lodPixelSize = -1.0f;
+    };
+    void updateCircleLods(LayerGpu& gpu, float pixel);
+    // Replays the layer's edit log into its geometry; false when it needs a rebuild
+    bool patchLayer(const Layer& layer, LayerGpu& gpu);
+
+    std::unordered_map<uint32_t, LayerGpu> layer_gpu;  // Keyed by Layer::id
+    std::vector<uint32_t> dirty_layers;
+    std::vector<LayerGeometry*> dirty_geometry;
+    GeometryPatch geometry_patch;
+    BufferUploader uploader;
+
+    // Selection and hover highlight, drawn over the scene from its own small
+    // buffers so selecting never touches layer geometry. Lines are drawn as
+    // hairline tracks, which needs no chunk-relative quantization.
+    std::vector<TrackInstance> selection_tracks;
+    std::vector<CircleInstance> selection_circles;
+    GpuBuffer selectionTrackBuffer;
+    GpuBuffer selectionCircleBuffer;
+    uint64_t selection_revision = UINT64_MAX;
+    uint32_t selection_track_count = 0;     // Selected entities come first; hover follows
+    uint32_t selection_circle_count = 0;
+    bool preview_active = false;
+    glm::mat4 preview_transform = glm::mat4(1.0f);
+    PipelineCache pipeline_cache;
+
+    ThreadPool tessellation_pool;
+    Tessellator tessellator;
 
     static constexpr int FRAME_COUNT = 2;
 };
\ No newline at end of file
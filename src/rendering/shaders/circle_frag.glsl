@@ -0,0 +1,17 @@
+#version 450
+
+layout(location = 0) in vec2 fragLocal;
+layout(location = 1) flat in float fragRadius;
+layout(location = 2) flat in vec3 fragColor;
+
+layout(location = 0) out vec4 outFragColor;
+
+void main() {
+    // Distance to the circle outline, measured in pixels
+    float dist = length(fragLocal) - fragRadius;
+    float pixel = max(fwidth(dist), 1e-6);
+    float coverage = 1.0 - smoothstep(0.5, 1.5, abs(dist) / pixel);
+    if (coverage <= 0.0) discard;
+
+    outFragColor = vec4(fragColor, coverage);
+}
@@ -0,0 +1,59 @@
+#version 450
+
+// One instance per circle. Geometry comes from gl_VertexIndex: a quad
+// when circleSegments is 0, otherwise a ring of circleSegments pieces
+// hugging the outline so large circles do not shade their interior.
+layout(location = 0) in vec2 inCenter;
+layout(location = 1) in float inRadius;
+layout(location = 2) in uint inColorIndex;
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProj;
+    float pixelSize;        // World units per screen pixel
+    uint circleSegments;    // LOD bucket of the current draw
+    vec2 chunkOrigin;       // Line chunks only
+    vec2 chunkExtent;
+    uint palette[8];        // RGBA8 colors
+} pc;
+
+layout(location = 0) out vec2 fragLocal;
+layout(location = 1) flat out float fragRadius;
+layout(location = 2) flat out vec3 fragColor;
+
+const vec2 CORNERS[6] = vec2[](
+    vec2(-1.0, -1.0), vec2( 1.0, -1.0), vec2( 1.0,  1.0),
+    vec2(-1.0, -1.0), vec2( 1.0,  1.0), vec2(-1.0,  1.0)
+);
+
+// (segment step, outer rim) for the two triangles of a ring segment
+const uvec2 RING[6] = uvec2[](
+    uvec2(0, 0), uvec2(1, 0), uvec2(1, 1),
+    uvec2(0, 0), uvec2(1, 1), uvec2(0, 1)
+);
+
+const float PI = 3.14159265;
+
+void main() {
+    // Pad the geometry so the anti-aliased edge is never clipped
+    float margin = 2.0 * pc.pixelSize;
+    vec2 local;
+
+    if (pc.circleSegments == 0u) {
+        local = CORNERS[gl_VertexIndex] * (inRadius + margin);
+    } else {
+        uint segment = uint(gl_VertexIndex) / 6u;
+        uvec2 corner = RING[uint(gl_VertexIndex) % 6u];
+        float step = PI / float(pc.circleSegments);
+        float angle = float(segment + corner.x) * 2.0 * step;
+
+        // Outer polygon circumscribes the padded circle, inner one is inscribed
+        float outer = (inRadius + margin) / cos(step);
+        float inner = max(inRadius - margin, 0.0);
+        local = vec2(cos(angle), sin(angle)) * (corner.y == 1u ? outer : inner);
+    }
+
+    gl_Position = pc.viewProj * vec4(inCenter + local, 0.0, 1.0);
+    fragLocal = local;
+    fragRadius = inRadius;
+    fragColor = unpackUnorm4x8(pc.palette[min(inColorIndex, 7u)]).rgb;
+}
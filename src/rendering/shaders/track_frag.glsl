@@ -0,0 +1,19 @@
+#version 450
+
+layout(location = 0) in vec2 fragLocal;
+layout(location = 1) flat in float fragLength;
+layout(location = 2) flat in float fragHalfWidth;
+layout(location = 3) flat in vec3 fragColor;
+
+layout(location = 0) out vec4 outFragColor;
+
+void main() {
+    // Signed distance to the capsule: segment [0, length] on the x axis grown by halfWidth
+    vec2 nearest = vec2(clamp(fragLocal.x, 0.0, fragLength), 0.0);
+    float dist = length(fragLocal - nearest) - fragHalfWidth;
+    float pixel = max(fwidth(dist), 1e-6);
+    float coverage = clamp(0.5 - dist / pixel, 0.0, 1.0);
+    if (coverage <= 0.0) discard;
+
+    outFragColor = vec4(fragColor, coverage);
+}
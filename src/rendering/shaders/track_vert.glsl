@@ -0,0 +1,48 @@
+#version 450
+
+// One instance per track segment. The six vertices form a quad around
+// the capsule (the segment swept by a disc of halfWidth); the fragment
+// shader cuts the round caps and edges out of it analytically.
+layout(location = 0) in vec2 inP0;
+layout(location = 1) in vec2 inP1;
+layout(location = 2) in float inHalfWidth;
+layout(location = 3) in uint inColorIndex;
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProj;
+    float pixelSize;        // World units per screen pixel
+    uint circleSegments;
+    vec2 chunkOrigin;       // Line chunks only
+    vec2 chunkExtent;
+    uint palette[8];        // RGBA8 colors
+} pc;
+
+layout(location = 0) out vec2 fragLocal;        // (along, across) from p0, world units
+layout(location = 1) flat out float fragLength;
+layout(location = 2) flat out float fragHalfWidth;
+layout(location = 3) flat out vec3 fragColor;
+
+const vec2 CORNERS[6] = vec2[](
+    vec2(-1.0, -1.0), vec2( 1.0, -1.0), vec2( 1.0,  1.0),
+    vec2(-1.0, -1.0), vec2( 1.0,  1.0), vec2(-1.0,  1.0)
+);
+
+void main() {
+    vec2 axis = inP1 - inP0;
+    float len = length(axis);
+    vec2 dir = len > 0.0 ? axis / len : vec2(1.0, 0.0);
+    vec2 normal = vec2(-dir.y, dir.x);
+
+    // Keep tracks at least a pixel wide so zoomed-out boards do not fade away
+    float halfWidth = max(inHalfWidth, 0.5 * pc.pixelSize);
+    float extent = halfWidth + 2.0 * pc.pixelSize;
+
+    vec2 corner = CORNERS[gl_VertexIndex];
+    vec2 local = vec2(corner.x < 0.0 ? -extent : len + extent, corner.y * extent);
+
+    gl_Position = pc.viewProj * vec4(inP0 + dir * local.x + normal * local.y, 0.0, 1.0);
+    fragLocal = local;
+    fragLength = len;
+    fragHalfWidth = halfWidth;
+    fragColor = unpackUnorm4x8(pc.palette[min(inColorIndex, 7u)]).rgb;
+}
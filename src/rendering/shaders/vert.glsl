@@ -1,16 +1,21 @@
 #version 450
 
-layout(location = 0) in vec2 inPos;
-layout(location = 1) in vec3 inColor;
+layout(location = 0) in vec2 inPos;         // 0..1 across the chunk box (R16G16_UNORM)
+layout(location = 1) in uint inColorIndex;    // R16_UINT
 
 layout(push_constant) uniform PushConstants {
     mat4 viewProj;
+    float pixelSize;
+    uint circleSegments;
+    vec2 chunkOrigin;       // World-space box of the chunk being drawn
+    vec2 chunkExtent;
+    uint palette[8];        // RGBA8 colors
 } pc;
 
 layout(location = 0) out vec3 fragColor;
 
 void main() {
-    vec4 worldPos = vec4(inPos.x, inPos.y, 0.0, 1.0); // z=0, 2D locked
-    gl_Position = pc.viewProj * worldPos;
-    fragColor = inColor;
+    vec2 world = pc.chunkOrigin + inPos * pc.chunkExtent;
+    gl_Position = pc.viewProj * vec4(world, 0.0, 1.0); // z=0, 2D locked
+    fragColor = unpackUnorm4x8(pc.palette[min(inColorIndex, 7u)]).rgb;
 }
@@ -0,0 +1,359 @@
+// tessellator.cpp
+
+#include "rendering/tessellator.h"
+#include "core/cad_document.h"
+#include "utils/thread_pool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+    // Work is split so each job writes a few hundred KB
+    constexpr uint32_t LINES_PER_JOB = 16384;
+    constexpr uint32_t CIRCLES_PER_JOB = 16384;
+    constexpr uint32_t TRACKS_PER_JOB = 16384;
+    constexpr size_t VERTICES_PER_LINE = 2;
+
+    // Level L takes primitives at most LEVEL_SIZE * 2^L across, on tiles at
+    // most LEVEL_TILE * 2^L wide. A primitive overhangs its tile by at most
+    // half its size on each side, so chunk boxes stay within
+    // MAX_CHUNK_EXTENT * 2^L. Most primitives are small, so most of the
+    // extent goes to the tile to keep the chunk count down.
+    constexpr float LEVEL_SIZE = 0.25f * Tessellator::MAX_CHUNK_EXTENT;
+    constexpr float LEVEL_TILE = Tessellator::MAX_CHUNK_EXTENT - LEVEL_SIZE;
+    constexpr uint32_t LEVEL_COUNT = 16;
+    // Caps the tile arrays of a sparse, very wide layer; tiles past the cap
+    // are wider than their level allows
+    constexpr uint64_t MAX_TILES_PER_LEVEL = 1u << 18;
+
+    uint32_t levelOf(const Bounds& b) {
+        float size = std::max(b.maxX - b.minX, b.maxY - b.minY);
+        uint32_t level = 0;
+        while (level + 1 < LEVEL_COUNT && size > std::ldexp(LEVEL_SIZE, (int)level)) level++;
+        return level;
+    }
+
+    // Uniform grid over the primitive centers of one level of a layer; its
+    // tiles are numbered from `first` on
+    struct TileGrid {
+        float minX, minY, scaleX, scaleY;
+        uint32_t width, height;
+        uint32_t first;
+
+        uint32_t TileOf(float x, float y) const {
+            uint32_t tx = std::min(width - 1, (uint32_t)std::max(0.0f, (x - minX) * scaleX));
+            uint32_t ty = std::min(height - 1, (uint32_t)std::max(0.0f, (y - minY) * scaleY));
+            return first + ty * width + tx;
+        }
+    };
+
+    // Maps v in [lo, lo + extent] onto the full 16-bit range
+    uint16_t quantize(float v, float lo, float extent) {
+        if (extent <= 0.0f) return 0;
+        float t = (v - lo) / extent * 65535.0f + 0.5f;
+        return (uint16_t)std::clamp(t, 0.0f, 65535.0f);
+    }
+
+    // Chunk whose range of `first` (firstVertex, firstCircle, ...) holds
+    // element `e`. Chunks without any share their first with a neighbour,
+    // so take the last candidate.
+    template <typename Chunks>
+    auto& chunkOf(Chunks& chunks, uint32_t GeometryChunk::*first, uint32_t e) {
+        auto it = std::upper_bound(chunks.begin(), chunks.end(), e,
+            [first](uint32_t v, const GeometryChunk& c) { return v < c.*first; });
+        return *(it - 1);
+    }
+
+    const GeometryChunk& chunkOfVertex(const std::vector<GeometryChunk>& chunks, uint32_t vertex) {
+        return chunkOf(chunks, &GeometryChunk::firstVertex, vertex);
+    }
+
+    void expand(GeometryChunk& chunk, float minX, float minY, float maxX, float maxY) {
+        chunk.minX = std::min(chunk.minX, minX);
+        chunk.minY = std::min(chunk.minY, minY);
+        chunk.maxX = std::max(chunk.maxX, maxX);
+        chunk.maxY = std::max(chunk.maxY, maxY);
+    }
+
+    bool contains(const GeometryChunk& chunk, float minX, float minY, float maxX, float maxY) {
+        return minX >= chunk.minX && minY >= chunk.minY && maxX <= chunk.maxX && maxY <= chunk.maxY;
+    }
+
+    void writeLine(const LineArrays& lines, uint32_t i, const GeometryChunk& chunk, Vertex* dst) {
+        float w = chunk.maxX - chunk.minX, h = chunk.maxY - chunk.minY;
+        dst[0] = { { quantize(lines.x1[i], chunk.minX, w), quantize(lines.y1[i], chunk.minY, h) }, PALETTE_LINE };
+        dst[1] = { { quantize(lines.x2[i], chunk.minX, w), quantize(lines.y2[i], chunk.minY, h) }, PALETTE_LINE };
+    }
+}
+
+void Tessellator::binLayer(const Layer& layer, LayerGeometry& geometry) {
+    const LineArrays& lines = layer.lines;
+    const CircleArrays& circles = layer.circles;
+    const TrackArrays& tracks = layer.tracks;
+    uint32_t lineCount = (uint32_t)lines.Size();
+    uint32_t circleCount = (uint32_t)circles.Size();
+    uint32_t trackCount = (uint32_t)tracks.Size();
+
+    const EntityKind kinds[] = { EntityKind::Line, EntityKind::Circle, EntityKind::Track };
+    const uint32_t counts[] = { lineCount, circleCount, trackCount };
+    std::vector<uint32_t>* slots[] = { &geometry.lineSlot, &geometry.circleSlot, &geometry.trackSlot };
+
+    // Each primitive's size picks its level; the slot arrays temporarily
+    // hold levels, and then tile indices
+    struct LevelBounds {
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        uint32_t count = 0;
+    };
+    LevelBounds levels[LEVEL_COUNT];
+    std::vector<float> centers[3];
+    for (int k = 0; k < 3; ++k) {
+        slots[k]->resize(counts[k]);
+        centers[k].resize(2 * (size_t)counts[k]);
+        for (uint32_t i = 0; i < counts[k]; ++i) {
+            Bounds b = layer.EntityBounds(kinds[k], i);
+            uint32_t level = levelOf(b);
+            float cx = 0.5f * (b.minX + b.maxX), cy = 0.5f * (b.minY + b.maxY);
+            centers[k][2 * i] = cx;
+            centers[k][2 * i + 1] = cy;
+            LevelBounds& lb = levels[level];
+            lb.minX = std::min(lb.minX, cx); lb.maxX = std::max(lb.maxX, cx);
+            lb.minY = std::min(lb.minY, cy); lb.maxY = std::max(lb.maxY, cy);
+            lb.count++;
+            (*slots[k])[i] = level;
+        }
+    }
+
+    // Per level, enough tiles for the primitive budget, and none wider than the level allows
+    TileGrid grids[LEVEL_COUNT];
+    uint32_t tileCount = 0;
+    for (uint32_t level = 0; level < LEVEL_COUNT; ++level) {
+        const LevelBounds& lb = levels[level];
+        TileGrid& grid = grids[level];
+        grid.first = tileCount;
+        grid.width = grid.height = 0;
+        if (lb.count == 0) continue;
+
+        uint32_t tiles = (lb.count + PRIMITIVES_PER_CHUNK - 1) / PRIMITIVES_PER_CHUNK;
+        float w = std::max(lb.maxX - lb.minX, 1e-3f), h = std::max(lb.maxY - lb.minY, 1e-3f);
+        uint32_t width = std::clamp<uint32_t>((uint32_t)std::lround(std::sqrt(tiles * w / h)), 1, tiles);
+        uint32_t height = (tiles + width - 1) / width;
+
+        float side = std::ldexp(LEVEL_TILE, (int)level);
+        width = std::max(width, (uint32_t)std::min(std::ceil(w / side), (float)MAX_TILES_PER_LEVEL));
+        height = std::max(height, (uint32_t)std::min(std::ceil(h / side), (float)MAX_TILES_PER_LEVEL));
+        while ((uint64_t)width * height > MAX_TILES_PER_LEVEL) {
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+        }
+
+        grid.width = width;
+        grid.height = height;
+        grid.minX = lb.minX;
+        grid.minY = lb.minY;
+        grid.scaleX = width / w;
+        grid.scaleY = height / h;
+        tileCount += width * height;
+    }
+
+    // Count primitives per tile
+    std::vector<uint32_t> cursors[3];
+    for (int k = 0; k < 3; ++k) {
+        cursors[k].assign(tileCount, 0);
+        std::vector<uint32_t>& slot = *slots[k];
+        for (uint32_t i = 0; i < counts[k]; ++i) {
+            uint32_t t = grids[slot[i]].TileOf(centers[k][2 * i], centers[k][2 * i + 1]);
+            slot[i] = t;
+            cursors[k][t]++;
+        }
+    }
+    std::vector<uint32_t>& lineCursor = cursors[0];
+    std::vector<uint32_t>& circleCursor = cursors[1];
+    std::vector<uint32_t>& trackCursor = cursors[2];
+    std::vector<uint32_t> tileChunk(tileCount, 0);
+
+    // Non-empty tiles become chunks laid out back to back
+    geometry.chunks.clear();
+    uint32_t lineOffset = 0, circleOffset = 0, trackOffset = 0;
+    for (uint32_t level = 0; level < LEVEL_COUNT; ++level) {
+        const TileGrid& grid = grids[level];
+        float maxExtent = std::ldexp(MAX_CHUNK_EXTENT, (int)level);
+        for (uint32_t t = grid.first; t < grid.first + grid.width * grid.height; ++t) {
+            uint32_t lc = lineCursor[t], cc = circleCursor[t], tc = trackCursor[t];
+            if (lc == 0 && cc == 0 && tc == 0) continue;
+
+            tileChunk[t] = (uint32_t)geometry.chunks.size();
+            geometry.chunks.push_back({ FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX,
+                                        lineOffset * (uint32_t)VERTICES_PER_LINE, lc * (uint32_t)VERTICES_PER_LINE,
+                                        circleOffset, cc, trackOffset, tc, maxExtent });
+            lineCursor[t] = lineOffset;
+            circleCursor[t] = circleOffset;
+            trackCursor[t] = trackOffset;
+            lineOffset += lc;
+            circleOffset += cc;
+            trackOffset += tc;
+        }
+    }
+
+    // Assign final slots and grow chunk bounds to the full primitive extents
+    geometry.slotLine.resize(lineCount);
+    for (uint32_t i = 0; i < lineCount; ++i) {
+        uint32_t t = geometry.lineSlot[i];
+        geometry.lineSlot[i] = lineCursor[t]++;
+        geometry.slotLine[geometry.lineSlot[i]] = i;
+        expand(geometry.chunks[tileChunk[t]],
+               std::min(lines.x1[i], lines.x2[i]), std::min(lines.y1[i], lines.y2[i]),
+               std::max(lines.x1[i], lines.x2[i]), std::max(lines.y1[i], lines.y2[i]));
+    }
+
+    for (uint32_t i = 0; i < trackCount; ++i) {
+        uint32_t t = geometry.trackSlot[i];
+        geometry.trackSlot[i] = trackCursor[t]++;
+        float hw = 0.5f * tracks.width[i];
+        expand(geometry.chunks[tileChunk[t]],
+               std::min(tracks.x1[i], tracks.x2[i]) - hw, std::min(tracks.y1[i], tracks.y2[i]) - hw,
+               std::max(tracks.x1[i], tracks.x2[i]) + hw, std::max(tracks.y1[i], tracks.y2[i]) + hw);
+    }
+
+    // Circles are ordered by radius inside each chunk so LOD buckets stay contiguous
+    std::vector<uint32_t> order(circleCount);
+    for (uint32_t i = 0; i < circleCount; ++i) {
+        uint32_t t = geometry.circleSlot[i];
+        order[circleCursor[t]++] = i;
+        float r = circles.r[i];
+        expand(geometry.chunks[tileChunk[t]], circles.cx[i] - r, circles.cy[i] - r, circles.cx[i] + r, circles.cy[i] + r);
+    }
+    for (const GeometryChunk& chunk : geometry.chunks) {
+        auto first = order.begin() + chunk.firstCircle;
+        std::sort(first, first + chunk.circleCount,
+            [&](uint32_t a, uint32_t b) { return circles.r[a] < circles.r[b]; });
+    }
+    for (uint32_t slot = 0; slot < circleCount; ++slot)
+        geometry.circleSlot[order[slot]] = slot;
+
+    // Capacity is kept between rebuilds, so steady-state edits do not reallocate
+    geometry.vertices.resize(lineCount * VERTICES_PER_LINE);
+    geometry.circles.resize(circleCount);
+    geometry.tracks.resize(trackCount);
+}
+
+void Tessellator::Build(const CADDocument& doc, const std::vector<uint32_t>& layers,
+                        const std::vector<LayerGeometry*>& out, ThreadPool& pool) {
+    const auto& docLayers = doc.GetLayers();
+
+    // Pass 1: bin each layer into chunks and size its output
+    pool.ParallelFor(layers.size(), 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+            binLayer(docLayers[layers[i]], *out[i]);
+    });
+
+    // Pass 2: every job writes its primitives to their own slots
+    jobs.clear();
+    for (size_t i = 0; i < layers.size(); ++i) {
+        const Layer& layer = docLayers[layers[i]];
+
+        uint32_t lineCount = (uint32_t)layer.lines.Size();
+        for (uint32_t b = 0; b < lineCount; b += LINES_PER_JOB)
+            jobs.push_back({ JobKind::Lines, layers[i], out[i], b, std::min(b + LINES_PER_JOB, lineCount) });
+
+        uint32_t circleCount = (uint32_t)layer.circles.Size();
+        for (uint32_t b = 0; b < circleCount; b += CIRCLES_PER_JOB)
+            jobs.push_back({ JobKind::Circles, layers[i], out[i], b, std::min(b + CIRCLES_PER_JOB, circleCount) });
+
+        uint32_t trackCount = (uint32_t)layer.tracks.Size();
+        for (uint32_t b = 0; b < trackCount; b += TRACKS_PER_JOB)
+            jobs.push_back({ JobKind::Tracks, layers[i], out[i], b, std::min(b + TRACKS_PER_JOB, trackCount) });
+    }
+
+    pool.ParallelFor(jobs.size(), 1, [&](size_t first, size_t last) {
+        for (size_t j = first; j < last; ++j) {
+            const Job& job = jobs[j];
+            const Layer& layer = docLayers[job.layer];
+            LayerGeometry& geometry = *job.target;
+
+            if (job.kind == JobKind::Lines) {
+                const LineArrays& lines = layer.lines;
+                for (uint32_t i = job.begin; i < job.end; ++i) {
+                    uint32_t slot = geometry.lineSlot[i];
+                    const GeometryChunk& chunk = chunkOfVertex(geometry.chunks, slot * (uint32_t)VERTICES_PER_LINE);
+                    writeLine(lines, i, chunk, geometry.vertices.data() + slot * VERTICES_PER_LINE);
+                }
+            } else if (job.kind == JobKind::Circles) {
+                const CircleArrays& src = layer.circles;
+                for (uint32_t i = job.begin; i < job.end; ++i)
+                    geometry.circles[geometry.circleSlot[i]] = { { src.cx[i], src.cy[i] }, src.r[i], PALETTE_CIRCLE };
+            } else {
+                const TrackArrays& src = layer.tracks;
+                for (uint32_t i = job.begin; i < job.end; ++i)
+                    geometry.tracks[geometry.trackSlot[i]] = { { src.x1[i], src.y1[i] }, { src.x2[i], src.y2[i] },
+                                                               0.5f * src.width[i], PALETTE_TRACK };
+            }
+        }
+    });
+}
+
+bool Tessellator::Patch(const Layer& layer, LayerGeometry& geometry, EntityKind kind, uint32_t index,
+                        GeometryPatch& patch) {
+    // Entities stay in the chunk they were binned into; a chunk only ever
+    // grows, and when it does its line vertices are requantized to the new
+    // box. Growing past maxExtent would coarsen every line in the chunk and
+    // defeat its culling, so the layer is binned again instead.
+    enum class Grow { Fits, Grew, TooLarge };
+    auto grow = [&](GeometryChunk& chunk, float minX, float minY, float maxX, float maxY) {
+        if (contains(chunk, minX, minY, maxX, maxY)) return Grow::Fits;
+        GeometryChunk grown = chunk;
+        expand(grown, minX, minY, maxX, maxY);
+        if (std::max(grown.maxX - grown.minX, grown.maxY - grown.minY) > chunk.maxExtent) return Grow::TooLarge;
+        chunk = grown;
+        for (uint32_t v = chunk.firstVertex; v < chunk.firstVertex + chunk.vertexCount; v += VERTICES_PER_LINE)
+            writeLine(layer.lines, geometry.slotLine[v / VERTICES_PER_LINE], chunk, geometry.vertices.data() + v);
+        if (chunk.vertexCount) patch.vertices.push_back({ chunk.firstVertex, chunk.vertexCount });
+        return Grow::Grew;
+    };
+
+    switch (kind) {
+    case EntityKind::Line: {
+        const LineArrays& l = layer.lines;
+        if (index >= geometry.lineSlot.size()) return false;
+        uint32_t vertex = geometry.lineSlot[index] * (uint32_t)VERTICES_PER_LINE;
+        GeometryChunk& chunk = chunkOf(geometry.chunks, &GeometryChunk::firstVertex, vertex);
+        Grow grew = grow(chunk, std::min(l.x1[index], l.x2[index]), std::min(l.y1[index], l.y2[index]),
+                         std::max(l.x1[index], l.x2[index]), std::max(l.y1[index], l.y2[index]));
+        if (grew == Grow::TooLarge) return false;
+        if (grew == Grow::Fits) {
+            writeLine(l, index, chunk, geometry.vertices.data() + vertex);
+            patch.vertices.push_back({ vertex, (uint32_t)VERTICES_PER_LINE });
+        }
+        return true;
+    }
+    case EntityKind::Circle: {
+        const CircleArrays& c = layer.circles;
+        if (index >= geometry.circleSlot.size()) return false;
+        uint32_t slot = geometry.circleSlot[index];
+        CircleInstance& instance = geometry.circles[slot];
+        if (instance.radius != c.r[index]) return false;
+        float r = c.r[index];
+        if (grow(chunkOf(geometry.chunks, &GeometryChunk::firstCircle, slot),
+                 c.cx[index] - r, c.cy[index] - r, c.cx[index] + r, c.cy[index] + r) == Grow::TooLarge)
+            return false;
+        instance.center[0] = c.cx[index];
+        instance.center[1] = c.cy[index];
+        patch.circles.push_back({ slot, 1 });
+        return true;
+    }
+    case EntityKind::Track: {
+        const TrackArrays& t = layer.tracks;
+        if (index >= geometry.trackSlot.size()) return false;
+        uint32_t slot = geometry.trackSlot[index];
+        float hw = 0.5f * t.width[index];
+        if (grow(chunkOf(geometry.chunks, &GeometryChunk::firstTrack, slot),
+                 std::min(t.x1[index], t.x2[index]) - hw, std::min(t.y1[index], t.y2[index]) - hw,
+                 std::max(t.x1[index], t.x2[index]) + hw, std::max(t.y1[index], t.y2[index]) + hw) == Grow::TooLarge)
+            return false;
+        geometry.tracks[slot] = { { t.x1[index], t.y1[index] }, { t.x2[index], t.y2[index] }, hw, PALETTE_TRACK };
+        patch.tracks.push_back({ slot, 1 });
+        return true;
+    }
+    }
+    return false;
+}
@@ -0,0 +1,102 @@
+// tessellator.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/entity/entity.h"
+#include "rendering/vertex.h"
+
+class CADDocument;
+class Layer;
+class ThreadPool;
+
+// Spatial tile of a layer: a contiguous run of its vertices and circles
+// plus the world-space box that bounds them. Line vertices are quantized
+// relative to this box, so the box must not outgrow maxExtent on either axis.
+struct GeometryChunk {
+    float minX, minY, maxX, maxY;
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    uint32_t firstCircle;
+    uint32_t circleCount;
+    uint32_t firstTrack;
+    uint32_t trackCount;
+    float maxExtent;
+};
+
+// CPU-side geometry of one layer, ready for upload
+struct LayerGeometry {
+    std::vector<Vertex> vertices;           // Line list, grouped by chunk, chunk-relative positions
+    std::vector<CircleInstance> circles;    // Grouped by chunk, sorted by radius inside each
+    std::vector<TrackInstance> tracks;      // Grouped by chunk
+    std::vector<GeometryChunk> chunks;
+
+    // Where document line/circle/track i landed: vertices[2 * lineSlot[i]],
+    // circles[circleSlot[i]], tracks[trackSlot[i]]
+    std::vector<uint32_t> lineSlot;
+    std::vector<uint32_t> circleSlot;
+    std::vector<uint32_t> trackSlot;
+    std::vector<uint32_t> slotLine;         // Inverse of lineSlot
+};
+
+// Element ranges of a LayerGeometry rewritten by Tessellator::Patch
+struct GeometryPatch {
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+    };
+    std::vector<Range> vertices;
+    std::vector<Range> circles;
+    std::vector<Range> tracks;
+
+    void Clear() { vertices.clear(); circles.clear(); tracks.clear(); }
+    bool Empty() const { return vertices.empty() && circles.empty() && tracks.empty(); }
+};
+
+// Turns document geometry into GPU-ready arrays: line-list vertices,
+// circle instances and track instances, binned into spatial chunks for culling. Output sizes
+// are known up front, so each array is sized once and disjoint ranges
+// are filled in parallel.
+class Tessellator {
+public:
+    // Aim for chunks small enough to cull well but large enough to keep draw counts low
+    static constexpr uint32_t PRIMITIVES_PER_CHUNK = 4096;
+    // Widest chunk box for ordinary primitives. Line vertices land on a
+    // 65535-step grid across the box, 0.0024 units here; at the closest zoom
+    // the view is 2 units tall, about 0.0028 units per pixel at 720 pixels.
+    // Primitives too large to fit go to coarser levels of twice the extent
+    // per level, so their error stays proportional to their own size.
+    static constexpr float MAX_CHUNK_EXTENT = 160.0f;
+
+    // Rebuilds *out[i] from document layer layers[i]. Hidden layers are
+    // built too, so toggling visibility never needs a rebuild.
+    void Build(const CADDocument& doc, const std::vector<uint32_t>& layers,
+               const std::vector<LayerGeometry*>& out, ThreadPool& pool);
+
+    // Rewrites one edited entity in place, in the chunk it was binned into.
+    // A chunk whose box has to grow gets its lines requantized. Returns
+    // false when the edit cannot be patched and the layer needs a Build:
+    // a circle changed radius, which breaks the LOD ordering, or the chunk
+    // would outgrow its maxExtent.
+    static bool Patch(const Layer& layer, LayerGeometry& geometry, EntityKind kind, uint32_t index,
+                      GeometryPatch& patch);
+
+private:
+    enum class JobKind : uint8_t { Lines, Circles, Tracks };
+
+    // Contiguous slice of one layer's lines or circles
+    struct Job {
+        JobKind kind;
+        uint32_t layer;
+        LayerGeometry* target;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    static void binLayer(const Layer& layer, LayerGeometry& geometry);
+
+    std::vector<Job> jobs;
+};
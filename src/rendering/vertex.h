@@ -0,0 +1,42 @@
+// vertex.h
+
+#pragma once
+
+#include <cstdint>
+
+// Line vertex, 8 bytes. Positions are quantized to 16 bits per axis
+// across the bounds of the chunk the vertex belongs to; the shader
+// rebuilds world space from the chunk box pushed with each draw. The
+// palette index needs only 3 bits, so it takes 16 and the rest is padding
+// that keeps the stride 4-byte aligned.
+struct Vertex {
+    uint16_t pos[2];
+    uint16_t colorIndex;
+    uint16_t pad;
+};
+static_assert(sizeof(Vertex) == 8, "line vertices are uploaded as 8-byte records");
+
+// Colors the shaders look up by index; the palette itself is pushed with the camera
+enum PaletteIndex : uint32_t {
+    PALETTE_LINE = 0,
+    PALETTE_CIRCLE = 1,
+    PALETTE_TRACK = 2,
+    PALETTE_SELECTION = 3,
+    PALETTE_HOVER = 4,
+};
+static constexpr uint32_t PALETTE_SIZE = 8;
+
+// One circle drawn by the instanced path; expanded to a quad on the GPU
+struct CircleInstance {
+    float center[2];
+    float radius;
+    uint32_t colorIndex;
+};
+
+// One wide track segment; expanded to a capsule-bounding quad on the GPU
+struct TrackInstance {
+    float p0[2];
+    float p1[2];
+    float halfWidth;
+    uint32_t colorIndex;
+};
@@ -0,0 +1,81 @@
+// thread_pool.cpp
+
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    // The calling thread takes part in every loop, so spawn one fewer worker
+    size_t spawn = threadCount > 1 ? threadCount - 1 : 0;
+    workers.reserve(spawn);
+    for (size_t i = 0; i < spawn; ++i)
+        workers.emplace_back([this] { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+
+    if (workers.empty() || count <= grain) {
+        fn(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobCount = count;
+        jobGrain = grain;
+        nextChunk = 0;
+        chunkCount = (count + grain - 1) / grain;
+        chunksDone = 0;
+        ++generation;
+    }
+    wake.notify_all();
+
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return chunksDone == chunkCount; });
+    job = nullptr;
+}
+
+void ThreadPool::runChunks() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (job && nextChunk < chunkCount) {
+        size_t chunk = nextChunk++;
+        const auto* fn = job;
+        size_t begin = chunk * jobGrain;
+        size_t end = std::min(begin + jobGrain, jobCount);
+
+        lock.unlock();
+        (*fn)(begin, end);
+        lock.lock();
+
+        if (++chunksDone == chunkCount)
+            finished.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        runChunks();
+    }
+}
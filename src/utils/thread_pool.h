@@ -0,0 +1,45 @@
+// thread_pool.h
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops.
+// ParallelFor blocks the caller, which also works on the loop.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadCount() const { return workers.size() + 1; }
+
+    // Calls fn(begin, end) over [0, count) in chunks of at most `grain` items
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+private:
+    void workerLoop();
+    void runChunks();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    // State of the loop currently being executed (guarded by mutex)
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    size_t jobCount = 0;
+    size_t jobGrain = 1;
+    size_t nextChunk = 0;
+    size_t chunkCount = 0;
+    size_t chunksDone = 0;
+    size_t generation = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,165 @@
+// entity_id_test.cpp
+
+#include "test.h"
+
+#include <map>
+#include <random>
+
+#include "core/cad_document.h"
+
+namespace {
+    // Every live entity by id: its kind followed by its field values
+    using Snapshot = std::map<uint64_t, std::vector<float>>;
+
+    Snapshot snapshot(const CADDocument& doc) {
+        Snapshot out;
+        for (const Layer& layer : doc.GetLayers()) {
+            for (EntityKind kind : { EntityKind::Line, EntityKind::Circle, EntityKind::Track }) {
+                const std::vector<float>* fields[Layer::MAX_FIELDS];
+                size_t n = layer.FieldArrays(kind, fields);
+                for (uint32_t i = 0; i < layer.Size(kind); i++) {
+                    std::vector<float> values{ (float)kind };
+                    for (size_t f = 0; f < n; f++) values.push_back((*fields[f])[i]);
+                    out[doc.IdOf({ layer.id, kind, i }).Key()] = values;
+                }
+            }
+        }
+        return out;
+    }
+
+    // The slot table, both indexes and the selection agree with the arrays
+    bool consistent(const CADDocument& doc) {
+        size_t entities = 0;
+        for (const Layer& layer : doc.GetLayers()) {
+            size_t snaps = 0;
+            for (EntityKind kind : { EntityKind::Line, EntityKind::Circle, EntityKind::Track }) {
+                if (layer.slots[(size_t)kind].size() != layer.Size(kind)) return false;
+                for (uint32_t i = 0; i < layer.Size(kind); i++) {
+                    EntityRef ref;
+                    if (!doc.Resolve(doc.IdOf({ layer.id, kind, i }), ref) || ref != EntityRef{ layer.id, kind, i }) return false;
+                    SnapPoint points[Layer::MAX_SNAP_POINTS];
+                    snaps += layer.SnapPointsOf(kind, i, points);
+                }
+                entities += layer.Size(kind);
+            }
+            if (layer.index.Size() != layer.lines.Size() + layer.circles.Size() + layer.tracks.Size()) return false;
+            if (layer.snaps.Size() != snaps) return false;
+        }
+        for (EntityId id : doc.GetSelection())
+            if (!doc.Contains(id)) return false;
+        return doc.EntityCount() == entities;
+    }
+}
+
+TEST(entity_id, stale_ids_never_resolve) {
+    CADDocument doc;
+    EntityId a = doc.AddLine(0, 0.0f, 0.0f, 1.0f, 1.0f);
+    EntityId b = doc.AddLine(0, 2.0f, 2.0f, 3.0f, 3.0f);
+    CHECK(!a.IsNull() && a != b);
+    CHECK(doc.AddLine(7, 0.0f, 0.0f, 1.0f, 1.0f).IsNull());     // No such layer
+
+    doc.DeleteEntities({ a });
+    CHECK(!doc.Contains(a));
+    EntityRef ref;
+    CHECK(doc.Resolve(b, ref) && ref.index == 0);                // b moved into a's place
+
+    // The freed slot is reused under a new generation
+    EntityId c = doc.AddCircle(0, 5.0f, 5.0f, 1.0f);
+    CHECK(c.slot == a.slot && c.generation != a.generation);
+    CHECK(!doc.Contains(a));
+
+    // Undo brings back the exact ids
+    CHECK(doc.Undo());
+    CHECK(!doc.Contains(c));
+    CHECK(doc.Undo());
+    CHECK(doc.Contains(a) && doc.Contains(b));
+    CHECK(doc.Resolve(a, ref) && ref.index == 0);
+    CHECK(doc.Redo() && doc.Redo());
+    CHECK(doc.Contains(c) && !doc.Contains(a));
+}
+
+TEST(entity_id, selection_follows_deletes) {
+    CADDocument doc;
+    std::vector<EntityId> ids;
+    for (int i = 0; i < 10; i++) ids.push_back(doc.AddTrack(0, (float)i, 0.0f, (float)i + 1.0f, 0.0f, 0.2f));
+    doc.SetSelection({ ids[2], ids[9] });
+    doc.SetHover(ids[2]);
+    doc.DeleteEntities({ ids[2] });
+
+    // The deleted track dropped out; the last one moved into index 2 and
+    // the selection still finds it
+    CHECK(doc.GetSelection().size() == 1 && doc.GetSelection()[0] == ids[9] && doc.GetHover().IsNull());
+    std::vector<EntityRef> refs = doc.SelectionRefs();
+    CHECK(refs.size() == 1 && refs[0].index == 2);
+}
+
+// Adds, deletes, transforms and undo in random order, checked after every step
+TEST(entity_id, random_mix_with_undo) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto coord = [&] { return unit(rng) * 100.0f; };
+
+    CADDocument doc;
+    doc.AddLayer("Top");
+    std::vector<EntityId> known;
+    for (int i = 0; i < 200; i++) {
+        size_t layer = i % 2;
+        if (i % 3 == 0) known.push_back(doc.AddLine(layer, coord(), coord(), coord(), coord()));
+        else if (i % 3 == 1) known.push_back(doc.AddCircle(layer, coord(), coord(), 1.0f + unit(rng)));
+        else known.push_back(doc.AddTrack(layer, coord(), coord(), coord(), coord(), 0.5f));
+    }
+    doc.ClearHistory();
+
+    std::vector<Snapshot> history{ snapshot(doc) };    // After each step that can be undone
+    auto pick = [&] { return known[rng() % known.size()]; };
+    int failures = 0;
+    for (int step = 0; step < 3000 && failures == 0; step++) {
+        float r = unit(rng);
+        if (r < 0.25f) {
+            known.push_back(doc.AddTrack(rng() % 2, coord(), coord(), coord(), coord(), 0.3f));
+        } else if (r < 0.5f) {
+            std::vector<EntityId> doomed;
+            for (int k = 0, n = 1 + rng() % 10; k < n; k++) doomed.push_back(pick());
+            std::vector<EntityId> selection;
+            for (int k = 0; k < 5; k++) selection.push_back(pick());
+            doc.SetSelection(selection);
+            bool any = false;
+            for (EntityId id : doomed) any |= doc.Contains(id);
+            doc.DeleteEntities(doomed);
+            for (EntityId id : doomed) failures += doc.Contains(id);
+            if (!any) continue;
+        } else if (r < 0.75f) {
+            std::vector<EntityRef> refs;
+            for (int k = 0; k < 20; k++) {
+                EntityRef ref;
+                if (doc.Resolve(pick(), ref)) refs.push_back(ref);
+            }
+            if (refs.empty()) continue;
+            doc.TransformEntities(refs, Affine2D::Rotation(90.0f, unit(rng) * 10.0f, 0.0f));
+        } else {
+            for (int k = 0, n = 1 + rng() % 4; k < n && doc.CanUndo(); k++) {
+                doc.Undo();
+                history.pop_back();
+                failures += snapshot(doc) != history.back() || !consistent(doc);
+            }
+            continue;
+        }
+        failures += !consistent(doc);
+        history.push_back(snapshot(doc));
+    }
+    CHECK(failures == 0);
+
+    // All the way back, then forward again. Steps undone last in the mix
+    // may still be redoable, so only the ones undone here are redone.
+    std::vector<Snapshot> undone{ snapshot(doc) };
+    while (doc.Undo()) undone.push_back(snapshot(doc));
+    CHECK(undone.back() == history.front());
+    undone.pop_back();
+    size_t redoMisses = 0;
+    while (!undone.empty() && doc.Redo()) {
+        redoMisses += snapshot(doc) != undone.back();
+        undone.pop_back();
+    }
+    CHECK(redoMisses == 0 && undone.empty());
+    CHECK(consistent(doc));
+}
@@ -0,0 +1,157 @@
+// list_pool_test.cpp
+
+#include "test.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+
+#include "core/list_pool.h"
+#include "core/snap_index.h"
+#include "core/spatial_index.h"
+
+namespace {
+    using Pool = ListPool<int>;
+
+    std::vector<int> items(const Pool& pool, const Pool::List& list) {
+        Pool::View view = pool.Items(list);
+        return { view.begin(), view.end() };
+    }
+}
+
+TEST(list_pool, reserved_lists_share_one_array) {
+    Pool pool;
+    Pool::List a, b;
+    pool.ReserveTotal(5);
+    pool.Reserve(a, 2);
+    pool.Reserve(b, 3);
+    for (int i = 0; i < 2; i++) pool.Push(a, i);
+    for (int i = 0; i < 3; i++) pool.Push(b, 10 + i);
+    CHECK(pool.Capacity() == 5);
+    CHECK(items(pool, a) == std::vector<int>({ 0, 1 }));
+    CHECK(items(pool, b) == std::vector<int>({ 10, 11, 12 }));
+
+    // The last list grows where it is; any other moves to the end
+    pool.Push(b, 13);
+    CHECK(b.offset == 2 && b.capacity == 6);
+    pool.Push(a, 2);
+    CHECK(a.offset == 8 && items(pool, a) == std::vector<int>({ 0, 1, 2 }));
+    CHECK(items(pool, b) == std::vector<int>({ 10, 11, 12, 13 }));
+
+    pool.At(a, 0) = pool.Back(a);
+    pool.PopBack(a);
+    CHECK(items(pool, a) == std::vector<int>({ 2, 1 }));
+}
+
+TEST(list_pool, compact_keeps_every_list) {
+    std::mt19937 rng(3);
+    Pool pool;
+    std::vector<Pool::List> lists(200);
+    std::vector<std::vector<int>> reference(lists.size());
+    bool compacted = false;
+    for (int step = 0; step < 50000; step++) {
+        size_t l = rng() % lists.size();
+        if (rng() % 8 == 0) {
+            pool.Release(lists[l]);
+            reference[l].clear();
+        } else {
+            pool.Push(lists[l], step);
+            reference[l].push_back(step);
+        }
+        if (pool.NeedsCompaction()) {
+            pool.Compact([&](auto&& visit) {
+                for (Pool::List& list : lists) visit(list);
+            });
+            compacted = true;
+        }
+    }
+    CHECK(compacted);
+    size_t wrong = 0, live = 0;
+    for (size_t l = 0; l < lists.size(); l++) {
+        wrong += items(pool, lists[l]) != reference[l];
+        live += reference[l].size();
+    }
+    CHECK(wrong == 0);
+    CHECK(pool.Capacity() < 4 * live);
+}
+
+// Both indexes keep their cells in a pool; churn them until it compacts
+TEST(list_pool, index_churn_matches_brute_force) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> pos(0.0f, 100.0f), size(0.1f, 2.0f), far(-300.0f, 400.0f);
+
+    SpatialIndex spatial;
+    std::map<uint32_t, Bounds> boxes;
+    std::vector<SpatialIndex::Entry> entries;
+    for (uint32_t i = 0; i < 20000; i++) {
+        float x = pos(rng), y = pos(rng), s = size(rng);
+        entries.push_back({ EntityKind::Line, i, { x, y, x + s, y + s } });
+        boxes[i] = entries.back().bounds;
+    }
+    spatial.BulkLoad(entries);
+
+    SnapIndex snaps;
+    std::vector<SnapPoint> points;
+    for (uint32_t i = 0; i < 20000; i++) points.push_back({ pos(rng), pos(rng), i, EntityKind::Line, SnapKind::Endpoint });
+    snaps.BulkLoad(points);
+
+    uint32_t next = 20000;
+    int spatialMisses = 0, snapMisses = 0;
+    for (int step = 0; step < 300000; step++) {
+        uint32_t op = rng() % 3;
+        if (op == 0) {
+            float x = rng() % 4 == 0 ? far(rng) : pos(rng), y = pos(rng), s = size(rng) * (rng() % 50 == 0 ? 40.0f : 1.0f);
+            spatial.Insert(EntityKind::Line, next, { x, y, x + s, y + s });
+            boxes[next] = { x, y, x + s, y + s };
+            SnapPoint p{ rng() % 4 == 0 ? far(rng) : pos(rng), pos(rng), next, EntityKind::Line, SnapKind::Endpoint };
+            snaps.Insert(p);
+            points.push_back(p);
+            next++;
+        } else {
+            auto it = boxes.lower_bound(rng() % next);
+            if (it == boxes.end()) it = boxes.begin();
+            if (op == 1) {
+                spatial.Remove(EntityKind::Line, it->first);
+                boxes.erase(it);
+                size_t k = rng() % points.size();
+                snapMisses += !snaps.Remove(points[k]);
+                points[k] = points.back();
+                points.pop_back();
+            } else {
+                float x = it->second.minX + (pos(rng) - 50.0f) * 0.05f, y = it->second.minY;
+                spatial.Update(EntityKind::Line, it->first, { x, y, x + 1.0f, y + 1.0f });
+                it->second = { x, y, x + 1.0f, y + 1.0f };
+            }
+        }
+
+        if (step % 5000 == 0) {
+            float x = far(rng), y = pos(rng);
+            Bounds q{ x, y, x + 30.0f, y + 20.0f };
+            std::vector<SpatialIndex::Hit> hits;
+            spatial.QueryBox(q, hits);
+            std::set<uint32_t> got, want;
+            for (const SpatialIndex::Hit& h : hits) got.insert(h.index);
+            for (const auto& [i, b] : boxes)
+                if (b.maxX >= q.minX && b.minX <= q.maxX && b.maxY >= q.minY && b.minY <= q.maxY) want.insert(i);
+            spatialMisses += got != want || hits.size() != got.size();
+
+            float radius = 3.0f, best = radius * radius, distance;
+            bool wantFound = false;
+            for (const SnapPoint& p : points) {
+                float dx = p.x - x, dy = p.y - y;
+                if (dx * dx + dy * dy <= best) {
+                    best = dx * dx + dy * dy;
+                    wantFound = true;
+                }
+            }
+            SnapPoint found;
+            bool gotFound = snaps.Nearest(x, y, radius, SNAP_ALL, found, distance);
+            snapMisses += gotFound != wantFound || (gotFound && std::abs(distance * distance - best) > 1e-3f);
+        }
+    }
+    CHECK(spatial.Size() == boxes.size());
+    CHECK(snaps.Size() == points.size());
+    CHECK(spatialMisses == 0);
+    CHECK(snapMisses == 0);
+}
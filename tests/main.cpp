@@ -0,0 +1,35 @@
+// main.cpp
+
+#include "test.h"
+
+#include <cstring>
+
+namespace test {
+    std::vector<Case>& Registry() {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    int& Failures() {
+        static int failures = 0;
+        return failures;
+    }
+}
+
+// core-tests [suite]: runs every case, or only those of one suite
+int main(int argc, char** argv) {
+    const char* suite = argc > 1 ? argv[1] : nullptr;
+    int ran = 0;
+    for (const test::Case& c : test::Registry()) {
+        if (suite && std::strcmp(suite, c.suite) != 0) continue;
+        int before = test::Failures();
+        c.fn();
+        std::printf("%s %s.%s\n", test::Failures() == before ? "ok  " : "FAIL", c.suite, c.name);
+        ran++;
+    }
+    if (ran == 0) {
+        std::printf("no tests in suite %s\n", suite ? suite : "(all)");
+        return 1;
+    }
+    return test::Failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+// random_board.cpp
+
+#include "random_board.h"
+
+#include "core/cad_document.h"
+
+void FillRandomBoard(CADDocument& doc, std::mt19937& rng, size_t count, float extent) {
+    std::uniform_real_distribution<float> pos(-extent, extent), len(-20.0f, 20.0f), size(0.5f, 4.0f);
+    doc.BeginBulkLoad();
+    for (size_t i = 0; i < count; i++) {
+        float x = pos(rng), y = pos(rng);
+        switch (i % 3) {
+        case 0: doc.AddTrack(0, x, y, x + len(rng), y + len(rng), size(rng) * 0.2f); break;
+        case 1: doc.AddLine(0, x, y, x + len(rng), y + len(rng)); break;
+        default: doc.AddCircle(0, x, y, size(rng)); break;
+        }
+    }
+    doc.EndBulkLoad();
+}
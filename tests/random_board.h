@@ -0,0 +1,13 @@
+// random_board.h
+
+#pragma once
+
+#include <cstddef>
+#include <random>
+
+class CADDocument;
+
+// Bulk-loads `count` lines, circles and tracks in equal shares onto layer 0,
+// placed uniformly in [-extent, extent] on both axes. Lines and tracks are
+// up to 20 units long, circles up to 4 units in radius.
+void FillRandomBoard(CADDocument& doc, std::mt19937& rng, size_t count, float extent);
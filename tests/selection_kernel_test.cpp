@@ -0,0 +1,197 @@
+// selection_kernel_test.cpp
+
+#include "test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "core/selection_kernel.h"
+
+namespace {
+    using SelectionKernel::Isa;
+
+    // Not a multiple of any vector width, so every kernel runs its scalar tail
+    constexpr size_t COUNT = 20011;
+
+    struct Scene {
+        std::vector<float> x1, y1, x2, y2, width, cx, cy, r;
+        std::vector<float> lassoX = { -50.0f, 30.0f, 60.0f, 0.0f, -40.0f };
+        std::vector<float> lassoY = { -50.0f, -60.0f, 20.0f, 70.0f, 10.0f };
+        Bounds box{ -30.0f, -20.0f, 40.0f, 35.0f };
+
+        Scene() {
+            std::mt19937 rng(1);
+            std::uniform_real_distribution<float> pos(-100.0f, 100.0f), len(-20.0f, 20.0f), size(0.5f, 15.0f);
+            for (size_t i = 0; i < COUNT; i++) {
+                x1.push_back(pos(rng));
+                y1.push_back(pos(rng));
+                x2.push_back(x1.back() + len(rng));
+                y2.push_back(y1.back() + len(rng));
+                width.push_back(size(rng) * 0.2f);
+                cx.push_back(pos(rng));
+                cy.push_back(pos(rng));
+                r.push_back(size(rng));
+            }
+        }
+        SegmentSpan Segments() const { return { x1.data(), y1.data(), x2.data(), y2.data() }; }
+        SegmentSpan Tracks() const { return { x1.data(), y1.data(), x2.data(), y2.data(), width.data() }; }
+        CircleSpan Circles() const { return { cx.data(), cy.data(), r.data() }; }
+    };
+
+    std::vector<Isa> supportedIsas() {
+        std::vector<Isa> isas;
+        for (Isa isa : { Isa::Scalar, Isa::Sse, Isa::Avx2 })
+            if (isa <= SelectionKernel::GetIsa()) isas.push_back(isa);
+        return isas;
+    }
+
+    // Per-entity versions, written independently of the kernels
+    Containment segmentInBox(float x1, float y1, float x2, float y2, const Bounds& b) {
+        auto inside = [&](float x, float y) { return x >= b.minX && x <= b.maxX && y >= b.minY && y <= b.maxY; };
+        bool in1 = inside(x1, y1), in2 = inside(x2, y2);
+        if (in1 && in2) return Containment::Inside;
+        if (in1 || in2) return Containment::Crossing;
+        if (std::max(x1, x2) < b.minX || std::min(x1, x2) > b.maxX || std::max(y1, y2) < b.minY || std::min(y1, y2) > b.maxY)
+            return Containment::Outside;
+        float cx[4] = { b.minX, b.maxX, b.maxX, b.minX }, cy[4] = { b.minY, b.minY, b.maxY, b.maxY };
+        int positive = 0, negative = 0;
+        for (int k = 0; k < 4; k++) {
+            float side = (x2 - x1) * (cy[k] - y1) - (y2 - y1) * (cx[k] - x1);
+            positive += side > 0.0f;
+            negative += side < 0.0f;
+        }
+        return (positive == 4 || negative == 4) ? Containment::Outside : Containment::Crossing;
+    }
+
+    Containment segmentInLasso(float x1, float y1, float x2, float y2, const std::vector<float>& xs, const std::vector<float>& ys) {
+        bool in1 = false, in2 = false, cross = false;
+        for (size_t i = 0, j = xs.size() - 1; i < xs.size(); j = i++) {
+            float ax = xs[j], ay = ys[j], bx = xs[i], by = ys[i];
+            if ((ay > y1) != (by > y1) && x1 < ax + (y1 - ay) * (bx - ax) / (by - ay)) in1 = !in1;
+            if ((ay > y2) != (by > y2) && x2 < ax + (y2 - ay) * (bx - ax) / (by - ay)) in2 = !in2;
+            float d1 = (bx - ax) * (y1 - ay) - (by - ay) * (x1 - ax);
+            float d2 = (bx - ax) * (y2 - ay) - (by - ay) * (x2 - ax);
+            float d3 = (x2 - x1) * (ay - y1) - (y2 - y1) * (ax - x1);
+            float d4 = (x2 - x1) * (by - y1) - (y2 - y1) * (bx - x1);
+            if (d1 * d2 < 0.0f && d3 * d4 < 0.0f) cross = true;
+        }
+        if (in1 && in2 && !cross) return Containment::Inside;
+        return (in1 || in2 || cross) ? Containment::Crossing : Containment::Outside;
+    }
+
+    // Circles in double precision. `slack` is how close the outline comes
+    // to being tangent to the region, where float rounding may go either way.
+    Containment circleInBox(double cx, double cy, double r, const Bounds& b, double& slack) {
+        double nx = std::max({ b.minX - cx, cx - b.maxX, 0.0 }), ny = std::max({ b.minY - cy, cy - b.maxY, 0.0 });
+        double fx = std::max(cx - b.minX, b.maxX - cx), fy = std::max(cy - b.minY, b.maxY - cy);
+        double nearD = std::hypot(nx, ny), farD = std::hypot(fx, fy);
+        double inset = std::min({ cx - r - b.minX, b.maxX - cx - r, cy - r - b.minY, b.maxY - cy - r });
+        slack = std::min({ std::fabs(nearD - r), std::fabs(farD - r), std::fabs(inset) });
+        if (inset >= 0.0) return Containment::Inside;
+        return (nearD <= r && farD >= r) ? Containment::Crossing : Containment::Outside;
+    }
+
+    Containment circleInLasso(double cx, double cy, double r, const std::vector<float>& xs, const std::vector<float>& ys,
+                              double& slack) {
+        bool center = false, cross = false;
+        double minD = 1e300;
+        slack = 1e300;
+        for (size_t i = 0, j = xs.size() - 1; i < xs.size(); j = i++) {
+            double ax = xs[j], ay = ys[j], bx = xs[i], by = ys[i];
+            if ((ay > cy) != (by > cy) && cx < ax + (cy - ay) * (bx - ax) / (by - ay)) center = !center;
+            double ex = bx - ax, ey = by - ay;
+            double t = std::clamp(((cx - ax) * ex + (cy - ay) * ey) / (ex * ex + ey * ey), 0.0, 1.0);
+            double nearD = std::hypot(cx - ax - t * ex, cy - ay - t * ey);
+            double farD = std::max(std::hypot(cx - ax, cy - ay), std::hypot(cx - bx, cy - by));
+            cross |= nearD <= r && farD >= r;
+            minD = std::min(minD, nearD);
+            slack = std::min({ slack, std::fabs(nearD - r), std::fabs(farD - r) });
+        }
+        if (center && !cross && minD >= r) return Containment::Inside;
+        return (cross || center) ? Containment::Crossing : Containment::Outside;
+    }
+}
+
+TEST(selection_kernel, segments_match_reference) {
+    Scene s;
+    Isa best = SelectionKernel::GetIsa();
+    std::vector<Containment> out(COUNT);
+    for (Isa isa : supportedIsas()) {
+        SelectionKernel::SetIsa(isa);
+        size_t boxMisses = 0, lassoMisses = 0;
+        SelectionKernel::ClassifyBox(s.Segments(), COUNT, s.box, out.data());
+        for (size_t i = 0; i < COUNT; i++)
+            boxMisses += out[i] != segmentInBox(s.x1[i], s.y1[i], s.x2[i], s.y2[i], s.box);
+        SelectionKernel::ClassifyLasso(s.Segments(), COUNT, s.lassoX.data(), s.lassoY.data(), s.lassoX.size(), out.data());
+        for (size_t i = 0; i < COUNT; i++)
+            lassoMisses += out[i] != segmentInLasso(s.x1[i], s.y1[i], s.x2[i], s.y2[i], s.lassoX, s.lassoY);
+        CHECK(boxMisses == 0);
+        CHECK(lassoMisses == 0);
+    }
+    SelectionKernel::SetIsa(best);
+}
+
+TEST(selection_kernel, circles_match_reference) {
+    Scene s;
+    Isa best = SelectionKernel::GetIsa();
+    std::vector<Containment> out(COUNT);
+    for (Isa isa : supportedIsas()) {
+        SelectionKernel::SetIsa(isa);
+        size_t boxMisses = 0, lassoMisses = 0;
+        double slack;
+        SelectionKernel::ClassifyBox(s.Circles(), COUNT, s.box, out.data());
+        for (size_t i = 0; i < COUNT; i++)
+            boxMisses += out[i] != circleInBox(s.cx[i], s.cy[i], s.r[i], s.box, slack) && slack > 1e-3;
+        SelectionKernel::ClassifyLasso(s.Circles(), COUNT, s.lassoX.data(), s.lassoY.data(), s.lassoX.size(), out.data());
+        for (size_t i = 0; i < COUNT; i++)
+            lassoMisses += out[i] != circleInLasso(s.cx[i], s.cy[i], s.r[i], s.lassoX, s.lassoY, slack) && slack > 1e-3;
+        CHECK(boxMisses == 0);
+        CHECK(lassoMisses == 0);
+    }
+    SelectionKernel::SetIsa(best);
+}
+
+// Every instruction set gives bit-identical results, tracks included
+TEST(selection_kernel, isas_agree) {
+    Scene s;
+    Isa best = SelectionKernel::GetIsa();
+    std::vector<std::vector<Containment>> results;
+    for (Isa isa : supportedIsas()) {
+        SelectionKernel::SetIsa(isa);
+        std::vector<Containment> all, out(COUNT);
+        SelectionKernel::ClassifyBox(s.Segments(), COUNT, s.box, out.data());
+        all.insert(all.end(), out.begin(), out.end());
+        SelectionKernel::ClassifyBox(s.Tracks(), COUNT, s.box, out.data());
+        all.insert(all.end(), out.begin(), out.end());
+        SelectionKernel::ClassifyBox(s.Circles(), COUNT, s.box, out.data());
+        all.insert(all.end(), out.begin(), out.end());
+        SelectionKernel::ClassifyLasso(s.Segments(), COUNT, s.lassoX.data(), s.lassoY.data(), s.lassoX.size(), out.data());
+        all.insert(all.end(), out.begin(), out.end());
+        SelectionKernel::ClassifyLasso(s.Circles(), COUNT, s.lassoX.data(), s.lassoY.data(), s.lassoX.size(), out.data());
+        all.insert(all.end(), out.begin(), out.end());
+        results.push_back(all);
+    }
+    for (size_t k = 1; k < results.size(); k++) CHECK(results[k] == results[0]);
+    SelectionKernel::SetIsa(best);
+}
+
+// A track counts as inside only if its whole footprint is
+TEST(selection_kernel, tracks_use_their_width) {
+    float x1 = 0.0f, y1 = 0.0f, x2 = 10.0f, y2 = 0.0f, width = 2.0f;
+    SegmentSpan track{ &x1, &y1, &x2, &y2, &width };
+    SegmentSpan line{ &x1, &y1, &x2, &y2 };
+    Containment out;
+
+    SelectionKernel::ClassifyBox(line, 1, { -0.5f, -0.5f, 10.5f, 0.5f }, &out);
+    CHECK(out == Containment::Inside);
+    SelectionKernel::ClassifyBox(track, 1, { -0.5f, -0.5f, 10.5f, 0.5f }, &out);
+    CHECK(out == Containment::Crossing);
+    SelectionKernel::ClassifyBox(track, 1, { -1.0f, -1.0f, 11.0f, 1.0f }, &out);
+    CHECK(out == Containment::Inside);
+    // Only the edge of the footprint reaches the box
+    SelectionKernel::ClassifyBox(track, 1, { 2.0f, 0.5f, 4.0f, 3.0f }, &out);
+    CHECK(out == Containment::Crossing);
+    SelectionKernel::ClassifyBox(line, 1, { 2.0f, 0.5f, 4.0f, 3.0f }, &out);
+    CHECK(out == Containment::Outside);
+}
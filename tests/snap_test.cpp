@@ -0,0 +1,120 @@
+// snap_test.cpp
+
+#include "test.h"
+
+#include <cmath>
+#include <random>
+
+#include "core/cad_document.h"
+#include "core/snap_engine.h"
+#include "random_board.h"
+
+namespace {
+    // Squared distance to the nearest snap point of an enabled kind on any
+    // visible layer, by walking every entity; false if none is in range
+    bool bruteNearest(const CADDocument& doc, float x, float y, float tolerance, uint32_t mask, float& best) {
+        best = tolerance * tolerance;
+        bool found = false;
+        for (const Layer& layer : doc.GetLayers()) {
+            if (!layer.visible) continue;
+            for (EntityKind kind : { EntityKind::Line, EntityKind::Circle, EntityKind::Track }) {
+                for (uint32_t i = 0; i < layer.Size(kind); i++) {
+                    SnapPoint points[Layer::MAX_SNAP_POINTS];
+                    size_t n = layer.SnapPointsOf(kind, i, points);
+                    for (size_t k = 0; k < n; k++) {
+                        float dx = points[k].x - x, dy = points[k].y - y;
+                        float d2 = dx * dx + dy * dy;
+                        if (d2 <= best && (mask & SnapBit(points[k].snap))) {
+                            best = d2;
+                            found = true;
+                        }
+                    }
+                }
+            }
+        }
+        return found;
+    }
+}
+
+TEST(snap, nearest_matches_brute_force) {
+    std::mt19937 rng(12345);
+    CADDocument doc;
+    FillRandomBoard(doc, rng, 30000, 1000.0f);
+    // Incremental adds on a second layer, some beyond the bulk-loaded extent
+    doc.AddLayer("Top");
+    std::uniform_real_distribution<float> far(-2000.0f, 2000.0f), tolerance(0.1f, 60.0f);
+    for (int i = 0; i < 2000; i++) {
+        float x = far(rng), y = far(rng);
+        doc.AddLine(1, x, y, x + 1.0f, y + 1.0f);
+    }
+
+    uint32_t masks[] = { SNAP_ALL, SnapBit(SnapKind::Endpoint), SnapBit(SnapKind::Midpoint) | SnapBit(SnapKind::Center) };
+    int misses = 0;
+    for (int q = 0; q < 300; q++) {
+        float x = far(rng), y = far(rng), tol = tolerance(rng);
+        uint32_t mask = masks[q % 3];
+        SnapPoint point;
+        uint32_t layerId;
+        float best;
+        bool want = bruteNearest(doc, x, y, tol, mask, best);
+        bool got = doc.NearestSnapPoint(x, y, tol, mask, point, layerId);
+        if (got != want) {
+            misses++;
+        } else if (got) {
+            float dx = point.x - x, dy = point.y - y;
+            if (std::fabs(dx * dx + dy * dy - best) > 1e-3f || !(mask & SnapBit(point.snap))) misses++;
+        }
+    }
+    CHECK(misses == 0);
+}
+
+TEST(snap, hidden_layers_do_not_snap) {
+    CADDocument doc;
+    doc.AddCircle(0, 10.0f, 10.0f, 1.0f);
+    SnapPoint point;
+    uint32_t layerId;
+    CHECK(doc.NearestSnapPoint(10.5f, 10.0f, 1.0f, SNAP_ALL, point, layerId));
+    doc.SetLayerVisible(0, false);
+    CHECK(!doc.NearestSnapPoint(10.5f, 10.0f, 1.0f, SNAP_ALL, point, layerId));
+}
+
+TEST(snap, selection_can_be_skipped) {
+    CADDocument doc;
+    EntityId moving = doc.AddCircle(0, 10.0f, 10.0f, 1.0f);
+    doc.AddLine(0, 10.5f, 10.0f, 20.0f, 10.0f);
+    doc.SetSelection({ moving });
+    SnapPoint point;
+    uint32_t layerId;
+    CHECK(doc.NearestSnapPoint(10.1f, 10.0f, 1.0f, SNAP_ALL, point, layerId));
+    CHECK(point.snap == SnapKind::Center);
+    CHECK(doc.NearestSnapPoint(10.1f, 10.0f, 1.0f, SNAP_ALL, point, layerId, true));
+    CHECK(point.kind == EntityKind::Line && point.x == 10.5f);
+
+    // The skip list follows the selection
+    doc.ClearSelection();
+    CHECK(doc.NearestSnapPoint(10.1f, 10.0f, 1.0f, SNAP_ALL, point, layerId, true));
+    CHECK(point.snap == SnapKind::Center);
+}
+
+TEST(snap, engine_prefers_objects_over_grid) {
+    CADDocument doc;
+    EntityId id = doc.AddLine(0, 0.25f, 0.25f, 4.25f, 0.25f);
+    SnapEngine engine;
+    engine.SetGrid(1.0f);
+    SnapResult r;
+
+    CHECK(engine.Snap(doc, 4.0f, 0.5f, 0.5f, r));
+    CHECK(r.kind == SnapKind::Endpoint && r.x == 4.25f && r.y == 0.25f);
+    EntityRef ref;
+    CHECK(doc.Resolve(id, ref) && r.entity == ref);
+
+    CHECK(engine.Snap(doc, 2.2f, 0.4f, 0.5f, r));
+    CHECK(r.kind == SnapKind::Midpoint && r.x == 2.25f);
+
+    // Nothing within tolerance: the grid
+    CHECK(engine.Snap(doc, 7.4f, 5.6f, 0.5f, r));
+    CHECK(r.kind == SnapKind::Grid && r.x == 7.0f && r.y == 6.0f);
+
+    engine.SetEnabled(SnapBit(SnapKind::Center));
+    CHECK(!engine.Snap(doc, 4.0f, 0.5f, 0.5f, r));
+}
@@ -0,0 +1,179 @@
+// spatial_index_test.cpp
+
+#include "test.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <random>
+#include <set>
+
+#include "core/spatial_index.h"
+
+namespace {
+    using Reference = std::map<uint32_t, Bounds>;
+
+    float distanceToBox(float x, float y, const Bounds& b) {
+        float dx = std::max(std::max(b.minX - x, x - b.maxX), 0.0f);
+        float dy = std::max(std::max(b.minY - y, y - b.maxY), 0.0f);
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    bool overlaps(const Bounds& a, const Bounds& b) {
+        return a.maxX >= b.minX && a.minX <= b.maxX && a.maxY >= b.minY && a.minY <= b.maxY;
+    }
+
+    // Index and brute-force answer agree exactly, with no duplicates
+    bool boxMatches(const SpatialIndex& index, const Reference& reference, const Bounds& box) {
+        std::vector<SpatialIndex::Hit> hits;
+        index.QueryBox(box, hits);
+        std::set<uint32_t> got;
+        for (const SpatialIndex::Hit& h : hits) got.insert(h.index);
+        std::set<uint32_t> want;
+        for (const auto& [i, b] : reference)
+            if (overlaps(b, box)) want.insert(i);
+        return got == want && hits.size() == got.size();
+    }
+
+    // Distances of the k nearest agree with a sorted brute-force list
+    bool nearestMatches(const SpatialIndex& index, const Reference& reference, float x, float y, size_t k) {
+        std::vector<SpatialIndex::Hit> hits;
+        index.QueryNearest(x, y, k, hits);
+        std::vector<float> want;
+        for (const auto& [i, b] : reference) want.push_back(distanceToBox(x, y, b));
+        std::sort(want.begin(), want.end());
+        want.resize(std::min(k, want.size()));
+        if (hits.size() != want.size()) return false;
+        for (size_t i = 0; i < hits.size(); i++) {
+            auto found = reference.find(hits[i].index);
+            if (found == reference.end()) return false;
+            if (std::fabs(distanceToBox(x, y, found->second) - want[i]) > 1e-4f) return false;
+        }
+        return true;
+    }
+
+    Bounds randomBox(std::mt19937& rng, float extent, float maxSize) {
+        std::uniform_real_distribution<float> pos(-extent, extent), size(0.0f, maxSize);
+        float x = pos(rng), y = pos(rng);
+        return { x, y, x + size(rng), y + size(rng) };
+    }
+}
+
+TEST(spatial_index, bulk_load_matches_brute_force) {
+    std::mt19937 rng(3);
+    SpatialIndex index;
+    Reference reference;
+    std::vector<SpatialIndex::Entry> entries;
+    for (uint32_t i = 0; i < 20000; i++) {
+        Bounds b = randomBox(rng, 1000.0f, i % 100 == 0 ? 200.0f : 10.0f);
+        entries.push_back({ (EntityKind)(i % 3), i, b });
+        reference[i] = b;
+    }
+    index.BulkLoad(entries);
+    // Some beyond the loaded extent, which land in the sparse cells
+    for (uint32_t i = 20000; i < 21000; i++) {
+        Bounds b = randomBox(rng, 3000.0f, 5.0f);
+        index.Insert(EntityKind::Circle, i, b);
+        reference[i] = b;
+    }
+    CHECK(index.Size() == reference.size());
+
+    std::uniform_real_distribution<float> pos(-3000.0f, 3000.0f), size(0.0f, 300.0f);
+    int boxMisses = 0, nearestMisses = 0;
+    for (int q = 0; q < 100; q++) {
+        float x = pos(rng), y = pos(rng), w = size(rng);
+        if (!boxMatches(index, reference, { x, y, x + w, y + w })) boxMisses++;
+        if (!nearestMatches(index, reference, x, y, 8)) nearestMisses++;
+    }
+    CHECK(boxMisses == 0);
+    CHECK(nearestMisses == 0);
+}
+
+TEST(spatial_index, remove_and_update) {
+    std::mt19937 rng(5);
+    SpatialIndex index;
+    for (uint32_t i = 0; i < 10000; i++) index.Insert(EntityKind::Circle, i, randomBox(rng, 100.0f, 1.0f));
+    for (uint32_t i = 0; i < 10000; i += 2) index.Remove(EntityKind::Circle, i);
+    for (uint32_t i = 1; i < 10000; i += 4) index.Update(EntityKind::Circle, i, { 500.0f, 500.0f, 501.0f, 501.0f });
+
+    std::vector<SpatialIndex::Hit> hits;
+    index.QueryBox({ -1000.0f, -1000.0f, 1000.0f, 1000.0f }, hits);
+    CHECK(hits.size() == 5000);
+    hits.clear();
+    index.QueryBox({ 499.0f, 499.0f, 502.0f, 502.0f }, hits);
+    CHECK(hits.size() == 2500);
+    CHECK(!index.Contains(EntityKind::Circle, 0));
+    CHECK(index.Contains(EntityKind::Circle, 1));
+}
+
+// Random inserts, removes and moves, checked against the reference as they go
+TEST(spatial_index, churn_matches_brute_force) {
+    std::mt19937 rng(7);
+    SpatialIndex index;
+    Reference reference;
+    std::vector<SpatialIndex::Entry> entries;
+    for (uint32_t i = 0; i < 5000; i++) {
+        Bounds b = randomBox(rng, 100.0f, 2.0f);
+        entries.push_back({ EntityKind::Line, i, b });
+        reference[i] = b;
+    }
+    index.BulkLoad(entries);
+
+    uint32_t next = 5000;
+    int misses = 0;
+    for (int step = 0; step < 100000; step++) {
+        uint32_t op = rng() % 3;
+        if (op == 0 || reference.empty()) {
+            // Some far outside the grid, some large enough for a coarse level
+            Bounds b = randomBox(rng, rng() % 4 == 0 ? 400.0f : 100.0f, rng() % 50 == 0 ? 80.0f : 2.0f);
+            index.Insert(EntityKind::Line, next, b);
+            reference[next++] = b;
+        } else {
+            auto it = reference.lower_bound(rng() % next);
+            if (it == reference.end()) it = reference.begin();
+            if (op == 1) {
+                index.Remove(EntityKind::Line, it->first);
+                reference.erase(it);
+            } else {
+                Bounds b = randomBox(rng, 100.0f, 2.0f);
+                index.Update(EntityKind::Line, it->first, b);
+                it->second = b;
+            }
+        }
+        if (step % 2000 == 0) {
+            Bounds q = randomBox(rng, 400.0f, 60.0f);
+            if (!boxMatches(index, reference, q)) misses++;
+            if (!nearestMatches(index, reference, q.minX, q.minY, 4)) misses++;
+        }
+    }
+    CHECK(index.Size() == reference.size());
+    CHECK(misses == 0);
+}
+
+// The search radius must be able to reach the far corner of the extent
+TEST(spatial_index, nearest_reaches_far_corner) {
+    SpatialIndex index;
+    index.Insert(EntityKind::Line, 0, { 0.0f, 0.0f, 1.0f, 1.0f });
+    index.Insert(EntityKind::Line, 1, { 99.0f, 99.0f, 100.0f, 100.0f });
+
+    std::vector<SpatialIndex::Hit> hits;
+    index.QueryNearest(0.0f, 0.0f, 2, hits);
+    CHECK(hits.size() == 2);
+    index.QueryNearest(50.0f, -400.0f, 5, hits);
+    CHECK(hits.size() == 4);
+}
+
+// A box covering everything must not overflow the cell span
+TEST(spatial_index, huge_query_box) {
+    std::mt19937 rng(11);
+    SpatialIndex index;
+    std::vector<SpatialIndex::Entry> entries;
+    for (uint32_t i = 0; i < 1000; i++) entries.push_back({ EntityKind::Track, i, randomBox(rng, 50.0f, 1.0f) });
+    index.BulkLoad(entries);
+    index.Insert(EntityKind::Track, 1000, { 1e6f, 1e6f, 1e6f + 1.0f, 1e6f + 1.0f });
+
+    std::vector<SpatialIndex::Hit> hits;
+    index.QueryBox({ -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX }, hits);
+    CHECK(hits.size() == 1001);
+}
@@ -0,0 +1,183 @@
+// tessellator_test.cpp
+
+#include "test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "core/cad_document.h"
+#include "rendering/tessellator.h"
+#include "utils/thread_pool.h"
+#include "random_board.h"
+
+namespace {
+    void build(const CADDocument& doc, LayerGeometry& geometry) {
+        ThreadPool pool(2);
+        Tessellator tessellator;
+        tessellator.Build(doc, { 0 }, { &geometry }, pool);
+    }
+
+    const GeometryChunk& chunkOfVertex(const LayerGeometry& geometry, uint32_t vertex) {
+        auto it = std::upper_bound(geometry.chunks.begin(), geometry.chunks.end(), vertex,
+            [](uint32_t v, const GeometryChunk& c) { return v < c.firstVertex + c.vertexCount; });
+        return *it;
+    }
+
+    // Distance from a line's endpoints to where the shader puts its vertices
+    double lineError(const Layer& layer, const LayerGeometry& geometry, uint32_t i) {
+        uint32_t v = geometry.lineSlot[i] * 2;
+        const GeometryChunk& c = chunkOfVertex(geometry, v);
+        auto decode = [&](const Vertex& vertex, float x, float y) {
+            double dx = c.minX + vertex.pos[0] / 65535.0 * ((double)c.maxX - c.minX) - x;
+            double dy = c.minY + vertex.pos[1] / 65535.0 * ((double)c.maxY - c.minY) - y;
+            return std::max(std::fabs(dx), std::fabs(dy));
+        };
+        return std::max(decode(geometry.vertices[v], layer.lines.x1[i], layer.lines.y1[i]),
+                        decode(geometry.vertices[v + 1], layer.lines.x2[i], layer.lines.y2[i]));
+    }
+
+    bool inside(const GeometryChunk& c, const Bounds& b) {
+        return b.minX >= c.minX && b.minY >= c.minY && b.maxX <= c.maxX && b.maxY <= c.maxY;
+    }
+
+    // Entities whose geometry does not show the document: lines further
+    // than a quantization step off, instances that differ, or anything
+    // outside its chunk's box or in a chunk past its maxExtent
+    int mismatches(const Layer& layer, const LayerGeometry& geometry) {
+        int bad = 0;
+        for (const GeometryChunk& c : geometry.chunks)
+            bad += std::max(c.maxX - c.minX, c.maxY - c.minY) > c.maxExtent;
+        for (uint32_t i = 0; i < layer.lines.Size(); i++) {
+            const GeometryChunk& c = chunkOfVertex(geometry, geometry.lineSlot[i] * 2);
+            double step = std::max(c.maxX - c.minX, c.maxY - c.minY) / 65535.0;
+            bad += lineError(layer, geometry, i) > step || !inside(c, layer.EntityBounds(EntityKind::Line, i));
+        }
+        for (uint32_t i = 0; i < layer.circles.Size(); i++) {
+            uint32_t slot = geometry.circleSlot[i];
+            const CircleInstance& ci = geometry.circles[slot];
+            auto it = std::upper_bound(geometry.chunks.begin(), geometry.chunks.end(), slot,
+                [](uint32_t s, const GeometryChunk& c) { return s < c.firstCircle + c.circleCount; });
+            bad += ci.center[0] != layer.circles.cx[i] || ci.center[1] != layer.circles.cy[i] ||
+                   ci.radius != layer.circles.r[i] || !inside(*it, layer.EntityBounds(EntityKind::Circle, i));
+        }
+        for (uint32_t i = 0; i < layer.tracks.Size(); i++) {
+            uint32_t slot = geometry.trackSlot[i];
+            const TrackInstance& ti = geometry.tracks[slot];
+            auto it = std::upper_bound(geometry.chunks.begin(), geometry.chunks.end(), slot,
+                [](uint32_t s, const GeometryChunk& c) { return s < c.firstTrack + c.trackCount; });
+            bad += ti.p0[0] != layer.tracks.x1[i] || ti.p0[1] != layer.tracks.y1[i] ||
+                   ti.p1[0] != layer.tracks.x2[i] || ti.p1[1] != layer.tracks.y2[i] ||
+                   ti.halfWidth != 0.5f * layer.tracks.width[i] || !inside(*it, layer.EntityBounds(EntityKind::Track, i));
+        }
+        return bad;
+    }
+
+    // Replays the layer's edits since `revision` as the renderer does
+    bool patch(const Layer& layer, LayerGeometry& geometry, uint64_t revision, GeometryPatch& out) {
+        for (const Layer::Edit& e : layer.edits)
+            if (e.revision > revision && !Tessellator::Patch(layer, geometry, e.kind, e.index, out)) return false;
+        return true;
+    }
+}
+
+// Chunks are cut by extent as well as by count, so quantized lines stay
+// within a pixel at the closest zoom; long primitives do not coarsen the rest
+TEST(tessellator, line_error_stays_below_a_pixel) {
+    // At zoom 1 the view is 2 units tall; 720 pixels is a small viewport
+    CHECK(Tessellator::MAX_CHUNK_EXTENT / 65535.0f < 2.0f / 720.0f);
+
+    std::mt19937 rng(3);
+    CADDocument doc;
+    FillRandomBoard(doc, rng, 60000, 2000.0f);
+    std::uniform_real_distribution<float> pos(-2000.0f, 2000.0f), len(100.0f, 5000.0f);
+    for (int i = 0; i < 200; i++) {
+        float x = pos(rng), y = pos(rng);
+        doc.AddLine(0, x, y, x + len(rng), y - 0.5f * len(rng));
+    }
+    for (int i = 0; i < 20; i++) doc.AddCircle(0, pos(rng), pos(rng), 300.0f);
+    const Layer& layer = doc.GetLayers()[0];
+
+    LayerGeometry geometry;
+    build(doc, geometry);
+
+    int oversized = 0;
+    for (const GeometryChunk& c : geometry.chunks)
+        oversized += std::max(c.maxX - c.minX, c.maxY - c.minY) > c.maxExtent;
+    CHECK(oversized == 0);
+
+    int misses = 0;
+    for (uint32_t i = 0; i < layer.lines.Size(); i++) {
+        Bounds b = layer.EntityBounds(EntityKind::Line, i);
+        float size = std::max(b.maxX - b.minX, b.maxY - b.minY);
+        double bound = (size <= 0.25f * Tessellator::MAX_CHUNK_EXTENT ? Tessellator::MAX_CHUNK_EXTENT : 8.0f * size) / 65535.0;
+        misses += lineError(layer, geometry, i) > bound;
+    }
+    CHECK(misses == 0);
+
+    // Every instance lies in the box its chunk is culled by
+    int outside = 0;
+    for (uint32_t i = 0; i < layer.circles.Size(); i++) {
+        uint32_t slot = geometry.circleSlot[i];
+        auto it = std::upper_bound(geometry.chunks.begin(), geometry.chunks.end(), slot,
+            [](uint32_t s, const GeometryChunk& c) { return s < c.firstCircle + c.circleCount; });
+        outside += !inside(*it, layer.EntityBounds(EntityKind::Circle, i));
+    }
+    for (uint32_t i = 0; i < layer.tracks.Size(); i++) {
+        uint32_t slot = geometry.trackSlot[i];
+        auto it = std::upper_bound(geometry.chunks.begin(), geometry.chunks.end(), slot,
+            [](uint32_t s, const GeometryChunk& c) { return s < c.firstTrack + c.trackCount; });
+        outside += !inside(*it, layer.EntityBounds(EntityKind::Track, i));
+    }
+    CHECK(outside == 0);
+}
+
+// Small moves patch in place and match a fresh build; a move that would
+// stretch a chunk past its limit asks for a rebuild instead
+TEST(tessellator, patch_matches_build) {
+    std::mt19937 rng(5);
+    CADDocument doc;
+    FillRandomBoard(doc, rng, 30000, 1000.0f);
+    const Layer& layer = doc.GetLayers()[0];
+
+    LayerGeometry patched;
+    build(doc, patched);
+    uint64_t built = layer.revision;
+
+    std::vector<EntityRef> refs;
+    for (uint32_t i = 0; i < 300; i++) {
+        refs.push_back({ layer.id, EntityKind::Line, i * 31 });
+        refs.push_back({ layer.id, EntityKind::Circle, i * 29 });
+        refs.push_back({ layer.id, EntityKind::Track, i * 23 });
+    }
+    doc.TranslateEntities(refs, 6.0f, -4.5f);
+
+    GeometryPatch ranges;
+    CHECK(patch(layer, patched, built, ranges));
+    CHECK(!ranges.Empty());
+    CHECK(mismatches(layer, patched) == 0);
+
+    // Both show the document, so lines agree within two steps and instances exactly
+    LayerGeometry fresh;
+    build(doc, fresh);
+    CHECK(mismatches(layer, fresh) == 0);
+    int differ = 0;
+    for (uint32_t i = 0; i < layer.circles.Size(); i++) {
+        const CircleInstance& a = patched.circles[patched.circleSlot[i]];
+        const CircleInstance& b = fresh.circles[fresh.circleSlot[i]];
+        differ += a.center[0] != b.center[0] || a.center[1] != b.center[1] || a.radius != b.radius;
+    }
+    for (uint32_t i = 0; i < layer.tracks.Size(); i++) {
+        const TrackInstance& a = patched.tracks[patched.trackSlot[i]];
+        const TrackInstance& b = fresh.tracks[fresh.trackSlot[i]];
+        differ += a.p0[0] != b.p0[0] || a.p0[1] != b.p0[1] || a.p1[0] != b.p1[0] || a.p1[1] != b.p1[1] ||
+                  a.halfWidth != b.halfWidth;
+    }
+    CHECK(differ == 0);
+
+    // Dragged across the board, the line would stretch its chunk
+    built = layer.revision;
+    doc.TranslateEntities({ { layer.id, EntityKind::Line, 7 } }, 1500.0f, 0.0f);
+    ranges.Clear();
+    CHECK(!patch(layer, patched, built, ranges));
+}
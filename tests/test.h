@@ -0,0 +1,37 @@
+// test.h
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+// Just enough of a test framework for the core checks. TEST(suite, name)
+// defines a case; CHECK reports a failure and lets the case carry on, so
+// one run shows every mismatch. Each suite is its own CTest test.
+namespace test {
+    struct Case {
+        const char* suite;
+        const char* name;
+        void (*fn)();
+    };
+
+    std::vector<Case>& Registry();
+    int& Failures();
+
+    struct Registrar {
+        Registrar(const char* suite, const char* name, void (*fn)()) { Registry().push_back({ suite, name, fn }); }
+    };
+}
+
+#define TEST(suite, name)                                                           \
+    static void suite##_##name();                                                   \
+    static test::Registrar suite##_##name##_registrar(#suite, #name, suite##_##name); \
+    static void suite##_##name()
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);    \
+            test::Failures()++;                                                     \
+        }                                                                           \
+    } while (0)
@@ -0,0 +1,115 @@
+// transform_test.cpp
+
+#include "test.h"
+
+#include <algorithm>
+#include <random>
+
+#include "core/affine.h"
+#include "core/cad_document.h"
+#include "random_board.h"
+
+namespace {
+    using SelectionKernel::Isa;
+
+    float mapX(const Affine2D& m, float x, float y) { return m.a * x + m.b * y + m.tx; }
+    float mapY(const Affine2D& m, float x, float y) { return m.c * x + m.d * y + m.ty; }
+}
+
+// Every instruction set applies the map exactly as written, tail included
+TEST(transform, kernel_matches_reference_map) {
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> pos(-1000.0f, 1000.0f);
+    const size_t count = 10007;
+    std::vector<float> xs(count), ys(count);
+    for (size_t i = 0; i < count; i++) {
+        xs[i] = pos(rng);
+        ys[i] = pos(rng);
+    }
+
+    Isa best = SelectionKernel::GetIsa();
+    Affine2D m = Affine2D::Rotation(33.0f, 5.0f, 7.0f);
+    for (Isa isa : { Isa::Scalar, Isa::Sse, Isa::Avx2 }) {
+        if (isa > best) break;
+        SelectionKernel::SetIsa(isa);
+        std::vector<float> tx = xs, ty = ys;
+        SelectionKernel::TransformPoints(tx.data(), ty.data(), count, m);
+        size_t misses = 0;
+        for (size_t i = 0; i < count; i++)
+            misses += tx[i] != mapX(m, xs[i], ys[i]) || ty[i] != mapY(m, xs[i], ys[i]);
+        CHECK(misses == 0);
+    }
+    SelectionKernel::SetIsa(best);
+}
+
+TEST(transform, quarter_turns_and_mirrors_are_exact) {
+    Affine2D r = Affine2D::Rotation(90.0f, 1.0f, 2.0f);
+    CHECK(mapX(r, 3.0f, 2.0f) == 1.0f && mapY(r, 3.0f, 2.0f) == 4.0f);
+    Affine2D back = Affine2D::Rotation(-270.0f, 1.0f, 2.0f);
+    CHECK(r.a == back.a && r.b == back.b && r.c == back.c && r.d == back.d);
+
+    Affine2D h = Affine2D::Mirror(true, 10.0f, 0.0f);
+    CHECK(mapX(h, 12.0f, 5.0f) == 8.0f && mapY(h, 12.0f, 5.0f) == 5.0f);
+    Affine2D v = Affine2D::Mirror(false, 0.0f, 10.0f);
+    CHECK(mapX(v, 12.0f, 5.0f) == 12.0f && mapY(v, 12.0f, 5.0f) == 15.0f);
+
+    CHECK(r.LengthScale() == 1.0f);
+    CHECK(h.LengthScale() == 1.0f);
+    CHECK(Affine2D::Scale(2.0f, 0.0f, 0.0f).LengthScale() == 2.0f);
+}
+
+// The document applies the map to every kind and keeps both indexes in step
+TEST(transform, document_transform_keeps_indexes) {
+    std::mt19937 rng(1);
+    CADDocument doc;
+    FillRandomBoard(doc, rng, 20000, 1000.0f);
+
+    uint32_t layerId = doc.GetLayers()[0].id;
+    std::vector<EntityRef> refs;
+    for (uint32_t i = 100; i < 1100; i++) {
+        refs.push_back({ layerId, EntityKind::Track, i });
+        refs.push_back({ layerId, EntityKind::Line, i });
+        refs.push_back({ layerId, EntityKind::Circle, i });
+    }
+    Layer before = doc.GetLayers()[0];
+    Affine2D m = Affine2D::Rotation(90.0f, 12.5f, -40.0f);
+    m = { 2.0f * m.a, 2.0f * m.b, 2.0f * m.c, 2.0f * m.d, m.tx, m.ty };   // Rotate and double in size
+    doc.TransformEntities(refs, m);
+
+    const Layer& after = doc.GetLayers()[0];
+    size_t wrong = 0, unindexed = 0, unsnapped = 0;
+    std::vector<EntityRef> hits;
+    for (const EntityRef& r : refs) {
+        uint32_t i = r.index;
+        switch (r.kind) {
+        case EntityKind::Track:
+            wrong += after.tracks.x1[i] != mapX(m, before.tracks.x1[i], before.tracks.y1[i]) ||
+                     after.tracks.y2[i] != mapY(m, before.tracks.x2[i], before.tracks.y2[i]) ||
+                     after.tracks.width[i] != before.tracks.width[i] * 2.0f;
+            break;
+        case EntityKind::Line:
+            wrong += after.lines.x2[i] != mapX(m, before.lines.x2[i], before.lines.y2[i]) ||
+                     after.lines.y1[i] != mapY(m, before.lines.x1[i], before.lines.y1[i]);
+            break;
+        case EntityKind::Circle:
+            wrong += after.circles.cx[i] != mapX(m, before.circles.cx[i], before.circles.cy[i]) ||
+                     after.circles.cy[i] != mapY(m, before.circles.cx[i], before.circles.cy[i]) ||
+                     after.circles.r[i] != before.circles.r[i] * 2.0f;
+            break;
+        }
+
+        hits.clear();
+        doc.QueryBox(after.EntityBounds(r.kind, i), hits);
+        unindexed += std::find(hits.begin(), hits.end(), r) == hits.end();
+
+        SnapPoint points[Layer::MAX_SNAP_POINTS], found;
+        uint32_t foundLayer;
+        after.SnapPointsOf(r.kind, i, points);
+        unsnapped += !doc.NearestSnapPoint(points[0].x, points[0].y, 1e-3f, SNAP_ALL, found, foundLayer) ||
+                     found.x != points[0].x || found.y != points[0].y;
+    }
+    CHECK(wrong == 0);
+    CHECK(unindexed == 0);
+    CHECK(unsnapped == 0);
+    CHECK(after.tracks.x1[0] == before.tracks.x1[0]);   // Untouched stays put
+}
@@ -0,0 +1,131 @@
+// undo_test.cpp
+
+#include "test.h"
+
+#include <algorithm>
+#include <random>
+
+#include "core/cad_document.h"
+#include "core/edit_journal.h"
+#include "random_board.h"
+
+namespace {
+    bool sameGeometry(const Layer& a, const Layer& b) {
+        return a.lines.x1 == b.lines.x1 && a.lines.y1 == b.lines.y1 && a.lines.x2 == b.lines.x2 && a.lines.y2 == b.lines.y2 &&
+               a.circles.cx == b.circles.cx && a.circles.cy == b.circles.cy && a.circles.r == b.circles.r &&
+               a.tracks.x1 == b.tracks.x1 && a.tracks.y1 == b.tracks.y1 && a.tracks.x2 == b.tracks.x2 &&
+               a.tracks.y2 == b.tracks.y2 && a.tracks.width == b.tracks.width;
+    }
+
+    // Every entity of the layer is found by the spatial index at its box
+    size_t indexMisses(const CADDocument& doc, const Layer& layer) {
+        size_t misses = 0;
+        std::vector<EntityRef> hits;
+        for (EntityKind kind : { EntityKind::Line, EntityKind::Circle, EntityKind::Track }) {
+            for (uint32_t i = 0; i < layer.Size(kind); i++) {
+                hits.clear();
+                doc.QueryBox(layer.EntityBounds(kind, i), hits);
+                misses += std::find(hits.begin(), hits.end(), EntityRef{ layer.id, kind, i }) == hits.end();
+            }
+        }
+        return misses;
+    }
+}
+
+// Transforms and adds, undone to the start and redone to the end
+TEST(undo, undo_and_redo_restore_every_array) {
+    CADDocument doc;
+    std::mt19937 rng(1);
+    FillRandomBoard(doc, rng, 100000, 1000.0f);
+    CHECK(!doc.CanUndo());
+    const Layer original = doc.GetLayers()[0];
+    uint32_t layerId = original.id;
+
+    std::vector<EntityRef> refs;
+    for (uint32_t i = 0; i < 2000; i++) refs.push_back({ layerId, EntityKind::Track, 1000 + i });
+    for (uint32_t i = 0; i < 1500; i++) refs.push_back({ layerId, EntityKind::Line, 5000 + i * 7 });
+    for (uint32_t i = 0; i < 1500; i++) refs.push_back({ layerId, EntityKind::Circle, 7000 + i });
+    doc.TranslateEntities(refs, 3.0f, 4.0f);
+    doc.TransformEntities(refs, Affine2D::Rotation(90.0f, 10.0f, 10.0f));
+    doc.TransformEntities(refs, Affine2D::Scale(1.5f, 0.0f, 0.0f));
+    for (int i = 0; i < 100; i++) doc.AddLine(0, (float)i, (float)i, (float)i + 1.0f, (float)i);
+    doc.TransformEntities({ { layerId, EntityKind::Line, 25050 } }, Affine2D::Mirror(true, 0.0f, 0.0f));
+    const Layer edited = doc.GetLayers()[0];
+
+    // Edits in place undo through the edit log, without a layer rebuild
+    uint64_t structure = doc.GetLayers()[0].structureRevision;
+    CHECK(doc.Undo());
+    CHECK(doc.GetLayers()[0].structureRevision == structure);
+
+    int steps = 1;
+    while (doc.Undo()) steps++;
+    CHECK(steps == 104);
+    CHECK(sameGeometry(doc.GetLayers()[0], original));
+    CHECK(indexMisses(doc, doc.GetLayers()[0]) == 0);
+    CHECK(doc.GetLayers()[0].snaps.Size() == original.snaps.Size());
+
+    while (doc.Redo()) steps--;
+    CHECK(steps == 0);
+    CHECK(sameGeometry(doc.GetLayers()[0], edited));
+    CHECK(indexMisses(doc, doc.GetLayers()[0]) == 0);
+}
+
+TEST(undo, limit_keeps_newest_steps) {
+    CADDocument doc;
+    std::mt19937 rng(1);
+    FillRandomBoard(doc, rng, 1000, 1000.0f);
+    uint32_t layerId = doc.GetLayers()[0].id;
+    std::vector<EntityRef> refs;
+    for (uint32_t i = 0; i < 200; i++) refs.push_back({ layerId, EntityKind::Track, i });
+    for (int i = 0; i < 50; i++) doc.TranslateEntities(refs, 1.0f, 0.0f);
+    const Layer edited = doc.GetLayers()[0];
+
+    size_t full = doc.UndoMemoryUsed();
+    doc.SetUndoLimit(full / 2);
+    CHECK(doc.UndoMemoryUsed() <= full / 2);
+    int kept = 0;
+    while (doc.Undo()) kept++;
+    CHECK(kept > 0 && kept < 50);
+    while (doc.Redo()) {}
+    CHECK(sameGeometry(doc.GetLayers()[0], edited));
+
+    // A new edit after an undo drops what could have been redone
+    CHECK(doc.Undo());
+    doc.AddLine(0, 0.0f, 0.0f, 1.0f, 1.0f);
+    CHECK(!doc.CanRedo());
+}
+
+TEST(undo, journal_steps) {
+    EditJournal journal(1u << 20);
+    journal.BeginStep();
+    journal.EndStep();
+    CHECK(!journal.CanUndo());     // Empty steps leave no trace
+
+    for (uint32_t s = 0; s < 3; s++) {
+        journal.BeginStep();
+        EditJournal::Record* r = journal.AddRecord(EditJournal::Op::Modify, EntityKind::Line, 7, 0, 4, 1, 2);
+        for (uint32_t i = 0; i < 4; i++) {
+            r->Column(0)[i] = i;
+            r->Values()[i] = (float)s;
+            r->Values()[4 + i] = (float)s + 0.5f;
+        }
+        journal.EndStep();
+    }
+    CHECK(journal.AddRecord(EditJournal::Op::Modify, EntityKind::Line, 7, 0, 1, 0, 1) == nullptr);   // Outside a step
+
+    const std::vector<EditJournal::Record*>* records = journal.Undo();
+    CHECK(records && records->size() == 1);
+    EditJournal::Record* r = (*records)[0];
+    CHECK(r->layerId == 7 && r->count == 4 && r->Column(0)[3] == 3 && r->Values()[0] == 2.0f && r->Values()[7] == 2.5f);
+    CHECK(journal.Undo() && journal.Undo() && !journal.Undo());
+    CHECK(journal.Redo() && journal.CanRedo());
+
+    journal.BeginStep();     // Drops the two steps that could be redone
+    journal.AddRecord(EditJournal::Op::Insert, EntityKind::Circle, 1, 0, 1, 0, 3);
+    journal.EndStep();
+    CHECK(!journal.CanRedo());
+    CHECK(journal.Undo() && journal.Undo() && !journal.CanUndo());
+
+    journal.Clear();
+    CHECK(journal.MemoryUsed() == 0 && !journal.CanRedo());
+}